@@ -0,0 +1,141 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Bump allocator that owns every AST node of a compilation. Nodes are never
+// destroyed one by one, the whole arena is released at once, so anything
+// allocated here must not own resources: use pointers, std::span and
+// std::string_view rather than unique_ptr, vector or string.
+class AstArena
+{
+    static constexpr std::size_t block_size = 64 * 1024;
+
+    std::vector<std::unique_ptr<std::byte[]>> blocks;
+    std::byte *cursor = nullptr;
+    std::byte *limit = nullptr;
+
+    std::size_t bytes_used = 0;
+    std::size_t bytes_reserved = 0;
+
+    void *allocate_slow(std::size_t size, std::size_t align)
+    {
+        // Oversized requests get a block of their own so the current block
+        // can keep serving small nodes
+        std::size_t size_needed = size + align;
+        if (size_needed > block_size / 4)
+        {
+            auto &block = this->blocks.emplace_back(new std::byte[size_needed]);
+            this->bytes_reserved += size_needed;
+            this->bytes_used += size;
+            void *p = block.get();
+            return std::align(align, size, p, size_needed);
+        }
+
+        auto &block = this->blocks.emplace_back(new std::byte[block_size]);
+        this->bytes_reserved += block_size;
+        this->cursor = block.get();
+        this->limit = this->cursor + block_size;
+        return this->allocate(size, align);
+    }
+
+public:
+    AstArena() = default;
+    AstArena(const AstArena &) = delete;
+    AstArena &operator=(const AstArena &) = delete;
+
+    AstArena(AstArena &&other) noexcept
+    {
+        this->adopt(std::move(other));
+    }
+
+    void *allocate(std::size_t size, std::size_t align)
+    {
+        if (this->cursor)
+        {
+            auto address = reinterpret_cast<std::uintptr_t>(this->cursor);
+            auto aligned = (address + align - 1) & ~static_cast<std::uintptr_t>(align - 1);
+            if (aligned + size <= reinterpret_cast<std::uintptr_t>(this->limit))
+            {
+                std::byte *p = this->cursor + (aligned - address);
+                this->cursor = p + size;
+                this->bytes_used += size;
+                return p;
+            }
+        }
+
+        return this->allocate_slow(size, align);
+    }
+
+    template <typename T, typename... Args>
+    T *make(Args &&...args)
+    {
+        return new (this->allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // Copy a list into the arena, e.g. children collected in a scratch vector
+    template <typename T>
+    std::span<T> copy_array(const T *items, std::size_t count)
+    {
+        if (count == 0)
+        {
+            return {};
+        }
+
+        T *data = static_cast<T *>(this->allocate(sizeof(T) * count, alignof(T)));
+        std::uninitialized_copy(items, items + count, data);
+        return {data, count};
+    }
+
+    template <typename T>
+    std::span<T> copy_array(const std::vector<T> &items)
+    {
+        return this->copy_array(items.data(), items.size());
+    }
+
+    // Copy text into the arena, for names that don't exist in any source file
+    std::string_view copy_string(std::string_view text)
+    {
+        if (text.empty())
+        {
+            return {};
+        }
+
+        auto data = static_cast<char *>(this->allocate(text.size(), 1));
+        std::copy(text.begin(), text.end(), data);
+        return {data, text.size()};
+    }
+
+    // Take over every block of another arena, e.g. one filled on another thread
+    void adopt(AstArena &&other)
+    {
+        for (auto &block : other.blocks)
+        {
+            this->blocks.push_back(std::move(block));
+        }
+        this->bytes_used += other.bytes_used;
+        this->bytes_reserved += other.bytes_reserved;
+
+        other.blocks.clear();
+        other.cursor = other.limit = nullptr;
+        other.bytes_used = other.bytes_reserved = 0;
+    }
+
+    // Bytes handed out to nodes
+    std::size_t get_bytes_used() const
+    {
+        return this->bytes_used;
+    }
+
+    // Bytes requested from the system, including unused block tails
+    std::size_t get_bytes_reserved() const
+    {
+        return this->bytes_reserved;
+    }
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include "ast_arena.hpp"
+#include "flat_ast.hpp"
+#include "source_manager.hpp"
+
+// Bumped whenever the compiler or the format changes in a way that makes
+// stored ASTs stale
+constexpr std::string_view compiler_version = "jank-ast-3";
+
+// Header of a binary AST file. Every section is located by its byte offset
+// from the start of the file and node references are indices, so the file
+// contains no pointers and can be used straight from an mmap.
+struct AstFileHeader
+{
+    char magic[8];
+    std::uint64_t version_hash;
+
+    // Hash and size of the source the AST was parsed from
+    std::uint64_t source_hash;
+    std::uint64_t source_size;
+
+    std::uint32_t node_count;
+    std::uint32_t extra_count;
+    std::uint32_t constant_count;
+    std::uint32_t name_count;
+    std::uint32_t root_count;
+    std::uint32_t source_name_size;
+
+    std::uint64_t kinds_offset;     // FlatKind[node_count]
+    std::uint64_t a_offset;         // uint32[node_count]
+    std::uint64_t b_offset;         // uint32[node_count]
+    std::uint64_t locs_offset;      // uint32[node_count], relative to the source file
+    std::uint64_t extra_offset;     // uint32[extra_count]
+    std::uint64_t constants_offset; // uint64[constant_count]
+    std::uint64_t names_offset;     // uint64[name_count + 1], offsets into name data
+    std::uint64_t name_data_offset; // name bytes back to back
+    std::uint64_t roots_offset;     // uint32[root_count]
+    std::uint64_t source_offset;    // source name, then the source text
+    std::uint64_t file_size;
+};
+
+// A flattened program stored on disk, used for the AST cache and for
+// precompiled preludes. Loading maps the file and only checks the header and
+// the name table; expand() checks every node reference, then builds tree
+// nodes in one forward pass over the node arrays, with names pointing
+// straight into the mapping.
+class AstFile
+{
+    void *mapping = nullptr;
+    std::size_t mapping_size = 0;
+    std::string owned;
+
+    const std::byte *data = nullptr;
+    const AstFileHeader *header = nullptr;
+
+    AstFile() = default;
+
+    template <typename T>
+    std::span<const T> section(std::uint64_t offset, std::size_t count) const
+    {
+        return {reinterpret_cast<const T *>(this->data + offset), count};
+    }
+
+    bool validate() const;
+
+    // Whether every node refers to earlier nodes of the right kind, and to
+    // constants, names and extra ranges that exist
+    bool check_nodes() const;
+
+    void unmap();
+
+public:
+    AstFile(const AstFile &) = delete;
+    AstFile &operator=(const AstFile &) = delete;
+    AstFile(AstFile &&other) noexcept;
+    AstFile &operator=(AstFile &&other) noexcept;
+    ~AstFile();
+
+    // Map an AST file. Returns nothing if it is missing, truncated or was
+    // written by another compiler version.
+    static std::optional<AstFile> load(const std::string &path);
+
+    // Write a flattened program parsed from `file`. Goes through a temporary
+    // file so a concurrent reader never sees a partial AST.
+    static bool write(const std::string &path, const FlatAst &ast, const SourceManager &sources, FileId file);
+
+    // Content hash that keys the cache, covers the compiler version too
+    static std::uint64_t hash_source(std::string_view source);
+
+    // Cache file for a source inside `cache_dir`
+    static std::string cache_path(const std::string &cache_dir, std::string_view source);
+
+    // Whether this AST was parsed from exactly this text
+    bool matches(std::string_view source) const;
+
+    std::string_view get_source_name() const;
+
+    // Text the AST was parsed from, for diagnostics in prelude code
+    std::string_view get_source() const;
+
+    // Build tree nodes in arena, interning names into symbols. Locations are
+    // rebased onto `base`, the start of the file the source is registered as.
+    // Names point into this file, so it has to outlive the returned program.
+    // Returns nothing, having built nothing, if the nodes are malformed.
+    std::optional<std::vector<Stmt *>> expand(AstArena &arena, StringInterner &symbols, SourceLocation base) const;
+};
@@ -5,9 +5,39 @@
 #include <string>
 #include "parser.hpp"
 
+// Prints from an explicit stack of pending nodes rather than by recursion, so
+// arbitrarily deep trees can't overflow the native stack. print_node writes a
+// node's own line and schedules its children.
 class ASTPrinter
 {
+    struct Pending
+    {
+        const Stmt *stmt;
+        const Expr *expr;
+        int indent;
+    };
+
     int indent = 0;
+    std::vector<Pending> pending;
+
+    // Children are pushed last to first so they come off the stack in order
+    void schedule(const Stmt *stmt, int indent)
+    {
+        if (stmt)
+            this->pending.push_back({stmt, nullptr, indent});
+    }
+
+    void schedule(const Expr *expr, int indent)
+    {
+        if (expr)
+            this->pending.push_back({nullptr, expr, indent});
+    }
+
+    // Ends the line a LetStmt started, once its value has been printed
+    void schedule_newline()
+    {
+        this->pending.push_back({nullptr, nullptr, 0});
+    }
 
     void print_indent() const
     {
@@ -15,113 +45,140 @@ class ASTPrinter
             std::cout << "  ";
     }
 
-public:
-    void print(const Stmt *stmt)
+    void print_node(const LetStmt *let)
     {
-        if (!stmt)
-            return;
+        print_indent();
+        std::cout << "LetStmt: " << let->name << " = ";
+        schedule_newline();
+        schedule(let->value, indent);
+    }
 
-        if (auto let = dynamic_cast<const LetStmt *>(stmt))
-        {
-            print_indent();
-            std::cout << "LetStmt: " << let->name << " = ";
-            print(let->value.get());
-            std::cout << std::endl;
-        }
-        else if (auto exprStmt = dynamic_cast<const ExprStmt *>(stmt))
-        {
-            print_indent();
-            std::cout << "ExprStmt:\n";
-            ++indent;
-            print(exprStmt->expr.get());
-            --indent;
-        }
-        else if (auto ret = dynamic_cast<const ReturnStmt *>(stmt))
-        {
-            print_indent();
-            std::cout << "ReturnStmt:\n";
-            ++indent;
-            print(ret->value.get());
-            --indent;
-        }
-        else if (auto block = dynamic_cast<const BlockStmt *>(stmt))
-        {
-            print_indent();
-            std::cout << "BlockStmt:\n";
-            ++indent;
-            for (const auto &s : block->statements)
-                print(s.get());
-            --indent;
-        }
-        else if (auto fn = dynamic_cast<const FunctionStmt *>(stmt))
-        {
-            print_indent();
-            std::cout << "FunctionStmt: " << fn->name << "(";
-            for (size_t i = 0; i < fn->params.size(); ++i)
-            {
-                std::cout << fn->params[i];
-                if (i + 1 < fn->params.size())
-                    std::cout << ", ";
-            }
-            std::cout << ")\n";
-            ++indent;
-            print(fn->body.get());
-            --indent;
-        }
-        else
-        {
-            print_indent();
-            std::cout << "Unknown Stmt\n";
-        }
+    void print_node(const ExprStmt *exprStmt)
+    {
+        print_indent();
+        std::cout << "ExprStmt:\n";
+        schedule(exprStmt->expr, indent + 1);
     }
 
-    void print(const Expr *expr)
+    void print_node(const ReturnStmt *ret)
     {
-        if (!expr)
-            return;
+        print_indent();
+        std::cout << "ReturnStmt:\n";
+        schedule(ret->value, indent + 1);
+    }
 
-        if (auto i = dynamic_cast<const IntExpr *>(expr))
-        {
-            print_indent();
-            std::cout << "IntExpr: " << i->value << std::endl;
-        }
-        else if (auto f = dynamic_cast<const FloatExpr *>(expr))
-        {
-            print_indent();
-            std::cout << "FloatExpr: " << f->value << std::endl;
-        }
-        else if (auto s = dynamic_cast<const StringExpr *>(expr))
-        {
-            print_indent();
-            std::cout << "StringExpr: \"" << s->value << "\"" << std::endl;
-        }
-        else if (auto bin = dynamic_cast<const BinaryExpr *>(expr))
-        {
-            print_indent();
-            std::cout << "BinaryExpr: " << bin->op << std::endl;
-            ++indent;
-            print(bin->lhs.get());
-            print(bin->rhs.get());
-            --indent;
-        }
-        else if (auto call = dynamic_cast<const CallExpr *>(expr))
-        {
-            print_indent();
-            std::cout << "CallExpr: " << call->name << std::endl;
-            ++indent;
-            for (const auto &arg : call->arguments)
-                print(arg.get());
-            --indent;
-        }
-        else if (auto ident = dynamic_cast<const IdentifierExpr *>(expr))
+    void print_node(const BlockStmt *block)
+    {
+        print_indent();
+        std::cout << "BlockStmt:\n";
+        for (std::size_t i = block->statements.size(); i-- > 0;)
+            schedule(block->statements[i], indent + 1);
+    }
+
+    void print_node(const FunctionStmt *fn)
+    {
+        print_indent();
+        std::cout << "FunctionStmt: " << fn->name << "(";
+        for (size_t i = 0; i < fn->params.size(); ++i)
         {
-            print_indent();
-            std::cout << "IdentifierExpr: " << ident->name << std::endl;
+            std::cout << fn->params[i];
+            if (i + 1 < fn->params.size())
+                std::cout << ", ";
         }
-        else
+        std::cout << ")\n";
+        schedule(fn->body, indent + 1);
+    }
+
+    void print_node(const IfStmt *ifs)
+    {
+        print_indent();
+        std::cout << "IfStmt:\n";
+        schedule(ifs->else_branch, indent + 1);
+        schedule(ifs->then_branch, indent + 1);
+        schedule(ifs->condition, indent + 1);
+    }
+
+    void print_node(const WhileStmt *loop)
+    {
+        print_indent();
+        std::cout << "WhileStmt:\n";
+        schedule(loop->body, indent + 1);
+        schedule(loop->condition, indent + 1);
+    }
+
+    void print_node(const IntExpr *i)
+    {
+        print_indent();
+        std::cout << "IntExpr: " << i->value << std::endl;
+    }
+
+    void print_node(const FloatExpr *f)
+    {
+        print_indent();
+        std::cout << "FloatExpr: " << f->value << std::endl;
+    }
+
+    void print_node(const StringExpr *s)
+    {
+        print_indent();
+        std::cout << "StringExpr: \"" << s->value << "\"" << std::endl;
+    }
+
+    void print_node(const BinaryExpr *bin)
+    {
+        print_indent();
+        std::cout << "BinaryExpr: " << bin->op << std::endl;
+        schedule(bin->rhs, indent + 1);
+        schedule(bin->lhs, indent + 1);
+    }
+
+    void print_node(const CallExpr *call)
+    {
+        print_indent();
+        std::cout << "CallExpr: " << call->name << (call->tail ? " @tail" : "") << std::endl;
+        for (std::size_t i = call->arguments.size(); i-- > 0;)
+            schedule(call->arguments[i], indent + 1);
+    }
+
+    void print_node(const IdentifierExpr *ident)
+    {
+        print_indent();
+        std::cout << "IdentifierExpr: " << ident->name << std::endl;
+    }
+
+    void run(std::size_t base)
+    {
+        int start_indent = this->indent;
+        while (this->pending.size() > base)
         {
-            print_indent();
-            std::cout << "Unknown Expr\n";
+            Pending next = this->pending.back();
+            this->pending.pop_back();
+            this->indent = next.indent;
+
+            auto print_node = [this](const auto *node)
+            { this->print_node(node); };
+            if (next.stmt)
+                visit(next.stmt, print_node);
+            else if (next.expr)
+                visit(next.expr, print_node);
+            else
+                std::cout << std::endl;
         }
+        this->indent = start_indent;
+    }
+
+public:
+    void print(const Stmt *stmt)
+    {
+        std::size_t base = this->pending.size();
+        schedule(stmt, indent);
+        run(base);
+    }
+
+    void print(const Expr *expr)
+    {
+        std::size_t base = this->pending.size();
+        schedule(expr, indent);
+        run(base);
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,77 @@
+#pragma once
+#include <vector>
+#include "ast_arena.hpp"
+#include "evaluator.hpp"
+#include "stmt.hpp"
+#include "scope_stack.hpp"
+
+// Evaluates constant subexpressions on the AST and propagates immutable
+// bindings into their uses.
+//
+// A let bound to a constant, and a global no function assigns to, is
+// replaced by its value wherever it is read, for as long as no branch or
+// loop may have assigned it something else. Branches on a constant
+// condition are replaced by the one they take. Calls of pure functions with
+// constant arguments are run by the Evaluator and replaced by their result.
+// Local lets that end up unused that way are dropped, and globals whose
+// initializer folds to a literal become static data instead of being
+// computed when the program starts.
+//
+// Folding follows what the generated code would compute: ints wrap around,
+// ints mixed with floats are converted first, and divisions that would trap
+// are left for run time. It runs on a program that type checked, and keeps
+// the type of everything it replaces.
+class ConstantFolder
+{
+    AstArena &arena;
+
+    // Literal value of every name currently bound to a constant, nullptr if
+    // it isn't one. Globals sit in the outermost scope.
+    ScopeStack<const Expr *> constants;
+
+    const GlobalAnalysis &globals;
+
+    // Indexed by symbol id
+    std::vector<const Expr *> global_values;
+
+    // Scope depth of the function being folded, and the names let in its
+    // branches and loops, by symbol id
+    std::size_t function_depth = 0;
+    std::vector<bool> assigned;
+
+    Evaluator evaluator;
+
+    std::vector<std::pair<Expr **, bool>> work;
+
+    void bind_global(const LetStmt *let);
+    void fold_function(FunctionStmt *fn);
+    void fold_block(BlockStmt *block);
+    Stmt *fold_statement(Stmt *stmt);
+
+    // Stop treating the locals that stmt may assign as constants
+    void forget_assigned(Stmt *stmt);
+
+    // Whether a literal condition holds, nothing if it isn't a literal
+    static std::optional<bool> truth(const Expr *condition);
+
+    // Fold the expression in slot, replacing it if it changes
+    void fold(Expr **slot);
+
+    Expr *fold_binary(const BinaryExpr *bin);
+    Expr *fold_call(const CallExpr *call);
+
+    static bool is_literal(const Expr *expr)
+    {
+        return expr->kind == ExprKind::Int || expr->kind == ExprKind::Float || expr->kind == ExprKind::String;
+    }
+
+public:
+    // New nodes are allocated in arena, symbols is the table the program was
+    // parsed with, and types and globals have been analyzed for it
+    ConstantFolder(AstArena &arena, const StringInterner &symbols, const TypeInference &types,
+                   const GlobalAnalysis &globals)
+        : arena(arena), constants(symbols.size()), globals(globals), global_values(symbols.size()),
+          assigned(symbols.size()), evaluator(types, globals, global_values) {}
+
+    void run(std::vector<Stmt *> &program);
+};
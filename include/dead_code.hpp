@@ -0,0 +1,77 @@
+#pragma once
+#include <vector>
+#include "global_analysis.hpp"
+#include "inliner.hpp"
+#include "scope_stack.hpp"
+#include "stmt.hpp"
+#include "type_inference.hpp"
+
+// Drops functions and globals the program can't reach.
+//
+// Reachability starts at main and at the startup initializers that do
+// something besides computing their value. It follows calls to the instance
+// they resolve to, and reads and stores of globals, including the
+// initializers of lazy globals. It runs on the folded program, so calls that
+// were evaluated at compile time don't keep their callee alive, and functions
+// inlined everywhere only have their body walked. String
+// constants are pooled as they are emitted, so unreachable code's strings
+// go with it.
+class DeadCodeEliminator
+{
+    const TypeInference &types;
+    const GlobalAnalysis &globals;
+    const Inliner &inliner;
+
+    // Indexed by instance, whether its code is reached in any form
+    std::vector<bool> reached;
+    std::vector<const FunctionInstance *> worklist;
+
+    // Indexed by symbol id
+    std::vector<bool> live_globals;
+    std::vector<const LetStmt *> global_lets;
+
+    // Initializers of newly reached globals, walked before more functions
+    std::vector<const LetStmt *> initializers;
+
+    // Types of the locals in the instance being walked
+    ScopeStack<Type> locals;
+
+    std::vector<std::pair<const Expr *, bool>> work;
+    std::vector<Type> values;
+    std::vector<Type> arg_types;
+
+    void mark_instance(const FunctionInstance *instance);
+    void mark_global(SymbolId symbol);
+    void walk_instance(const FunctionInstance *instance);
+    void walk_block(std::span<Stmt *const> statements);
+
+    // Mark what expr reaches and return its type
+    Type walk(const Expr *root);
+
+    // Whether running expr does anything besides computing a value, or may
+    // trap or never finish instead
+    bool has_effects(const Expr *root) const;
+
+public:
+    // Numbers of declarations before and after run(), for --dce-stats
+    struct Stats
+    {
+        std::size_t functions = 0, live_functions = 0;
+        std::size_t instances = 0, live_instances = 0;
+        std::size_t globals = 0, live_globals = 0;
+    };
+
+    DeadCodeEliminator(const TypeInference &types, const GlobalAnalysis &globals, const Inliner &inliner,
+                       std::size_t symbol_count)
+        : types(types), globals(globals), inliner(inliner), reached(types.instance_count()),
+          live_globals(symbol_count), global_lets(symbol_count), locals(symbol_count) {}
+
+    // Remove unreachable declarations from program
+    Stats run(std::vector<Stmt *> &program);
+
+    // Whether an instance of a remaining function is ever called
+    bool is_live(const FunctionInstance *instance) const
+    {
+        return this->reached[this->types.index_of(instance)] && !this->inliner.inlines(instance->fn->symbol);
+    }
+};
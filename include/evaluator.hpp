@@ -0,0 +1,95 @@
+#pragma once
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "ast_arena.hpp"
+#include "global_analysis.hpp"
+#include "stmt.hpp"
+#include "type_inference.hpp"
+
+// A value known at compile time
+struct ConstValue
+{
+    Type type = Type::Void;
+    long integer = 0;
+    double floating = 0;
+    std::string_view string;
+
+    // Value of an int, float or string literal, nothing for anything else
+    static std::optional<ConstValue> of(const Expr *literal);
+
+    // Apply a binary operator like the generated code would: ints wrap
+    // around and mix with floats as doubles. Nothing for divisions that trap.
+    static std::optional<ConstValue> binary(char op, ConstValue lhs, ConstValue rhs);
+
+    ConstValue convert(Type to) const;
+
+    Expr *make_literal(AstArena &arena, SourceLocation loc) const;
+};
+
+// Runs calls of pure functions at compile time.
+//
+// Pure functions are the ones GlobalAnalysis found, so a call with constant
+// arguments always returns the same value. The interpreter walks the AST with explicit stacks
+// and gives up on a call once it takes too many steps or nests too deep,
+// since a loop or a recursion may never end.
+class Evaluator
+{
+    const TypeInference &types;
+    const GlobalAnalysis &globals;
+
+    // Indexed by symbol id, the literal value of each constant global and
+    // nullptr for the rest
+    const std::vector<const Expr *> &global_values;
+
+    static constexpr std::size_t max_steps = 100'000;
+    static constexpr std::size_t max_depth = 256;
+
+    // Spent over the whole compilation, evaluation stops once it runs out
+    std::size_t total_steps = 50'000'000;
+
+    struct Frame
+    {
+        const FunctionInstance *instance;
+        const Stmt *pending; // statement whose expression is being evaluated
+        std::size_t binding_base;
+        std::size_t work_base;
+        std::size_t block_base;
+    };
+
+    // A block being run, the function body at the bottom of each frame.
+    // Leaving a loop's body runs its condition again.
+    struct Block
+    {
+        std::span<Stmt *const> statements;
+        std::size_t next;
+        const WhileStmt *loop;
+        std::size_t binding_base;
+    };
+
+    std::vector<Frame> frames;
+    std::vector<Block> blocks;
+    std::vector<std::pair<SymbolId, ConstValue>> bindings;
+    std::vector<std::pair<const Expr *, bool>> work;
+    std::vector<ConstValue> values;
+    std::vector<Type> arg_types;
+
+    bool push_frame(const CallExpr *call, std::span<const ConstValue> args);
+    std::optional<ConstValue> lookup(SymbolId symbol) const;
+    void bind(SymbolId symbol, ConstValue value);
+    void enter(std::span<Stmt *const> statements, const WhileStmt *loop = nullptr);
+
+    // Start running stmt, false if it can't be evaluated
+    bool start(const Stmt *stmt);
+    std::optional<ConstValue> run();
+
+public:
+    Evaluator(const TypeInference &types, const GlobalAnalysis &globals,
+              const std::vector<const Expr *> &global_values)
+        : types(types), globals(globals), global_values(global_values) {}
+
+    // Result of a call to a pure function with these argument values, nothing
+    // if it doesn't finish within the budget or would trap
+    std::optional<ConstValue> call(const CallExpr *call, std::span<const ConstValue> args);
+};
@@ -1,55 +1,145 @@
 #pragma once
-#include <string>
-#include <memory>
-#include <vector>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include "source_manager.hpp"
+#include "interner.hpp"
 
+enum class ExprKind : std::uint8_t
+{
+    Int,
+    Float,
+    String,
+    Binary,
+    Identifier,
+    Call,
+};
+
+// Expressions live in an AstArena and are never destroyed individually, so
+// they only hold pointers, spans and views. Names and string values point into
+// the source buffer or the arena. Every name also carries its symbol id from
+// the program's StringInterner, which later passes index tables with.
+//
+// Dispatch goes through the kind tag, either with visit() below or a switch,
+// never through RTTI.
 struct Expr
 {
-    int line = -1;
-    virtual ~Expr() = default;
+    ExprKind kind;
+    SourceLocation loc;
+
+protected:
+    Expr(ExprKind kind, SourceLocation loc) : kind(kind), loc(loc) {}
 };
 
 struct IntExpr : Expr
 {
+    static constexpr ExprKind Kind = ExprKind::Int;
+
     long value;
-    IntExpr(int value, int line) : value(value) { this->line = line; }
+    IntExpr(long value, SourceLocation loc) : Expr(Kind, loc), value(value) {}
 };
 
 struct FloatExpr : Expr
 {
+    static constexpr ExprKind Kind = ExprKind::Float;
+
     double value;
-    FloatExpr(float value, int line) : value(value) { this->line = line; }
+    FloatExpr(double value, SourceLocation loc) : Expr(Kind, loc), value(value) {}
 };
 
 struct StringExpr : Expr
 {
-    std::string value;
-    StringExpr(std::string value, int line) : value(std::move(value)) { this->line = line; }
+    static constexpr ExprKind Kind = ExprKind::String;
+
+    std::string_view value;
+    StringExpr(std::string_view value, SourceLocation loc) : Expr(Kind, loc), value(value) {}
 };
 
 struct BinaryExpr : Expr
 {
-    std::unique_ptr<Expr> lhs;
-    std::string op;
-    std::unique_ptr<Expr> rhs;
+    static constexpr ExprKind Kind = ExprKind::Binary;
+
+    Expr *lhs;
+    std::string_view op;
+    Expr *rhs;
+
+    BinaryExpr(Expr *lhs, std::string_view op, Expr *rhs, SourceLocation loc)
+        : Expr(Kind, loc), lhs(lhs), op(op), rhs(rhs) {}
 
-    BinaryExpr(std::unique_ptr<Expr> lhs, std::string op, std::unique_ptr<Expr> rhs, int line)
-        : lhs(std::move(lhs)), op(op), rhs(std::move(rhs))
+    // Whether this can trap by itself: an integer division by anything but a
+    // literal other than 0 and -1. Operand types aren't known here, so a
+    // division that may be of floats counts too.
+    bool may_trap() const
     {
-        this->line = line;
+        if (this->op != "/" || this->rhs->kind == ExprKind::Float)
+            return false;
+        if (this->rhs->kind != ExprKind::Int)
+            return true;
+        long divisor = static_cast<const IntExpr *>(this->rhs)->value;
+        return divisor == 0 || divisor == -1;
     }
 };
 
 struct IdentifierExpr : Expr
 {
-    std::string name;
-    IdentifierExpr(std::string name, int line) : name(std::move(name)) { this->line = line; }
+    static constexpr ExprKind Kind = ExprKind::Identifier;
+
+    std::string_view name;
+    SymbolId symbol;
+    IdentifierExpr(std::string_view name, SymbolId symbol, SourceLocation loc)
+        : Expr(Kind, loc), name(name), symbol(symbol) {}
 };
 
 struct CallExpr : Expr
 {
-    std::string name;
-    std::vector<std::unique_ptr<Expr>> arguments;
-    CallExpr(std::string name, std::vector<std::unique_ptr<Expr>> arguments, int line)
-        : name(std::move(name)), arguments(std::move(arguments)) { this->line = line; }
-};
\ No newline at end of file
+    static constexpr ExprKind Kind = ExprKind::Call;
+
+    std::string_view name;
+    SymbolId symbol;
+    std::span<Expr *> arguments;
+
+    // Marked @tail: it has to be a call of the enclosing function that is
+    // returned as is, which then reuses the caller's frame
+    bool tail;
+
+    CallExpr(std::string_view name, SymbolId symbol, std::span<Expr *> arguments, SourceLocation loc, bool tail = false)
+        : Expr(Kind, loc), name(name), symbol(symbol), arguments(arguments), tail(tail) {}
+};
+
+static_assert(std::is_trivially_destructible_v<BinaryExpr> && std::is_trivially_destructible_v<CallExpr>,
+              "AST nodes are never destroyed individually");
+
+// Downcast if node has the kind of T, nullptr otherwise. Works for both
+// expressions and statements.
+template <typename T, typename Node>
+auto as(Node *node) -> std::conditional_t<std::is_const_v<Node>, const T *, T *>
+{
+    if (node && node->kind == T::Kind)
+    {
+        return static_cast<std::conditional_t<std::is_const_v<Node>, const T *, T *>>(node);
+    }
+    return nullptr;
+}
+
+// Call visitor with expr downcast to its concrete type. Every kind has to be
+// handled, a visitor missing an overload fails to compile.
+template <typename Visitor>
+decltype(auto) visit(const Expr *expr, Visitor &&visitor)
+{
+    switch (expr->kind)
+    {
+    case ExprKind::Int:
+        return visitor(static_cast<const IntExpr *>(expr));
+    case ExprKind::Float:
+        return visitor(static_cast<const FloatExpr *>(expr));
+    case ExprKind::String:
+        return visitor(static_cast<const StringExpr *>(expr));
+    case ExprKind::Binary:
+        return visitor(static_cast<const BinaryExpr *>(expr));
+    case ExprKind::Identifier:
+        return visitor(static_cast<const IdentifierExpr *>(expr));
+    case ExprKind::Call:
+        return visitor(static_cast<const CallExpr *>(expr));
+    }
+    __builtin_unreachable();
+}
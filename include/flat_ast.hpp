@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <vector>
+#include "interner.hpp"
+#include "stmt.hpp"
+
+using NodeIndex = std::uint32_t;
+
+constexpr NodeIndex no_node = UINT32_MAX;
+
+enum class FlatKind : std::uint8_t
+{
+    // Expressions
+    Int,        // a = constant index
+    Float,      // a = constant index
+    String,     // a = string id
+    Identifier, // a = name id
+    Add,        // a = lhs, b = rhs
+    Sub,
+    Mul,
+    Div,
+    Call,     // a = name id, b = extra index of [count, args...]
+    TailCall, // like Call, marked @tail
+
+    // Statements
+    Let,      // a = name id, b = value
+    ExprStmt, // a = expression
+    Return,   // a = value or no_node
+    Block,    // a = extra index of [count, statements...]
+    Function, // a = name id, b = extra index of [param count, param name ids..., body]
+    If,       // a = condition, b = extra index of [then block, else statement or no_node]
+    While,    // a = condition, b = body
+};
+
+// The AST as parallel arrays instead of a pointer-linked tree. A node is an
+// index; its kind, two 32-bit operands and source offset live in separate
+// arrays, 13 bytes per node in total. Variable-length child lists go into
+// `extra`, 64-bit literals into `constants`.
+//
+// Nodes are stored in post-order, children before their parent, so a pass
+// that only needs operands evaluated first can walk the arrays front to back.
+class FlatAst
+{
+public:
+    std::vector<FlatKind> kinds;
+    std::vector<std::uint32_t> a;
+    std::vector<std::uint32_t> b;
+    std::vector<SourceLocation> locs;
+
+    std::vector<std::uint32_t> extra;
+    std::vector<std::uint64_t> constants;
+
+    // Identifiers and string literal contents
+    StringInterner names;
+
+    // Top-level declarations in source order
+    std::vector<NodeIndex> roots;
+
+    // Flatten a parsed program
+    static FlatAst build(const std::vector<Stmt *> &program);
+
+    std::size_t size() const
+    {
+        return this->kinds.size();
+    }
+
+    FlatKind kind(NodeIndex node) const
+    {
+        return this->kinds[node];
+    }
+
+    std::int64_t int_value(NodeIndex node) const
+    {
+        return static_cast<std::int64_t>(this->constants[this->a[node]]);
+    }
+
+    double float_value(NodeIndex node) const;
+
+    std::string_view name(NodeIndex node) const
+    {
+        return this->names.get_name(this->a[node]);
+    }
+
+    // Children stored in `extra` for Call and Block nodes, and parameter
+    // name ids for Function nodes
+    std::span<const std::uint32_t> list(NodeIndex node) const
+    {
+        std::uint32_t start = (this->kinds[node] == FlatKind::Block) ? this->a[node] : this->b[node];
+        return {this->extra.data() + start + 1, this->extra[start]};
+    }
+
+    NodeIndex function_body(NodeIndex node) const
+    {
+        auto params = this->list(node);
+        return params.data()[params.size()];
+    }
+
+    // Bytes held by the node arrays and side tables
+    std::size_t memory_used() const;
+
+    // Same output as ASTPrinter, so the two representations can be diffed
+    void print(std::ostream &os) const;
+
+private:
+    NodeIndex add(FlatKind kind, std::uint32_t a, std::uint32_t b, SourceLocation loc);
+
+    NodeIndex flatten(const Expr *root);
+
+    NodeIndex flatten(const Stmt *stmt);
+
+    void print(std::ostream &os, NodeIndex node, int indent) const;
+};
@@ -0,0 +1,80 @@
+#pragma once
+#include <vector>
+#include "stmt.hpp"
+
+// Where a global's value lives and when it is computed
+enum class GlobalStorage : std::uint8_t
+{
+    None,     // not a global
+    ReadOnly, // static value that is never written, goes to .rodata
+    Data,     // static initial value, written later
+    Lazy,     // computed on first use by a getter
+    Startup,  // computed before main, in declaration order
+};
+
+// Whole-program facts about globals and the functions touching them.
+//
+// analyze() finds which globals functions write and which functions are
+// pure, meaning neither they nor their callees print, call outside code,
+// write a global or read one that is written. Like C++'s forward progress
+// rule, a loop that never ends doesn't make a function impure. classify()
+// then picks the storage of every global once initializers have been folded.
+class GlobalAnalysis
+{
+    // Indexed by symbol id
+    std::vector<const FunctionStmt *> functions;
+    std::vector<bool> globals;
+    std::vector<bool> written;
+    std::vector<bool> pure;
+    std::vector<bool> writes;
+    std::vector<GlobalStorage> storage;
+
+    // Spread a property from functions that have it to all their callers
+    static void propagate(std::vector<bool> &property, std::vector<SymbolId> seeds,
+                          const std::vector<std::pair<SymbolId, SymbolId>> &calls);
+
+    bool can_initialize_lazily(const Expr *init) const;
+
+public:
+    explicit GlobalAnalysis(std::size_t symbol_count)
+        : functions(symbol_count), globals(symbol_count), written(symbol_count), pure(symbol_count),
+          writes(symbol_count), storage(symbol_count) {}
+
+    void analyze(const std::vector<Stmt *> &program);
+
+    // Pick each global's storage from its (folded) initializer
+    void classify(const std::vector<Stmt *> &program);
+
+    bool is_function(SymbolId symbol) const
+    {
+        return this->functions[symbol] != nullptr;
+    }
+
+    bool is_global(SymbolId symbol) const
+    {
+        return this->globals[symbol];
+    }
+
+    // Whether any function assigns the global after it is initialized
+    bool is_written(SymbolId symbol) const
+    {
+        return this->written[symbol];
+    }
+
+    bool is_pure(SymbolId fn) const
+    {
+        return this->pure[fn];
+    }
+
+    // Whether calling fn may change a global. Functions that aren't defined
+    // here can't see jank globals.
+    bool writes_globals(SymbolId fn) const
+    {
+        return this->writes[fn];
+    }
+
+    GlobalStorage get_storage(SymbolId symbol) const
+    {
+        return this->storage[symbol];
+    }
+};
@@ -0,0 +1,44 @@
+#pragma once
+#include <span>
+#include <vector>
+#include "stmt.hpp"
+
+// Decides which functions are expanded at their call sites.
+//
+// A function's cost is the number of AST nodes codegen emits for it, with
+// the calls it inlines itself replaced by their cost. Inlining saves the call
+// and moving the arguments into place, so a function whose cost minus that
+// benefit is at most the threshold is inlined at every call. Functions on a
+// call cycle, functions that branch or loop and main never are, which also
+// bounds how deep expansion nests.
+class Inliner
+{
+    int threshold;
+
+    // Indexed by symbol id
+    std::vector<const FunctionStmt *> functions;
+    std::vector<bool> inlined;
+
+    // Statements codegen emits for fn, up to its first return
+    static std::span<Stmt *const> emitted(const FunctionStmt *fn);
+
+    static int benefit(const FunctionStmt *fn)
+    {
+        return 2 + static_cast<int>(fn->params.size());
+    }
+
+public:
+    static constexpr int default_threshold = 8;
+
+    Inliner(std::size_t symbol_count, int threshold)
+        : threshold(threshold), functions(symbol_count), inlined(symbol_count) {}
+
+    // Decide for every function of the folded program
+    void analyze(const std::vector<Stmt *> &program);
+
+    // Whether calls of fn are replaced by its body
+    bool inlines(SymbolId fn) const
+    {
+        return this->inlined[fn];
+    }
+};
@@ -0,0 +1,156 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+using SymbolId = std::uint32_t;
+
+// Maps each distinct name to a dense 32-bit id.
+//
+// The parser interns every identifier it sees, so lookups go through an
+// open-addressing table of (hash, id) slots rather than a node-based map, and
+// names are copied into the interner's own blocks. A hit then compares against
+// compact memory instead of wherever the name first appeared in the source.
+class StringInterner
+{
+    struct Slot
+    {
+        std::uint32_t hash;
+        std::uint32_t id; // empty_slot if unused
+    };
+
+    static constexpr std::uint32_t empty_slot = UINT32_MAX;
+
+    std::vector<Slot> slots = std::vector<Slot>(64, Slot{0, empty_slot});
+    std::vector<std::string_view> names;
+
+    // Storage for the name text, blocks never move once allocated
+    static constexpr std::size_t block_size = 16 * 1024;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char *cursor = nullptr;
+    char *limit = nullptr;
+
+    std::string_view store(std::string_view name)
+    {
+        if (static_cast<std::size_t>(this->limit - this->cursor) < name.size())
+        {
+            std::size_t size = std::max(block_size, name.size());
+            this->cursor = this->blocks.emplace_back(new char[size]).get();
+            this->limit = this->cursor + size;
+        }
+
+        char *data = this->cursor;
+        std::memcpy(data, name.data(), name.size());
+        this->cursor += name.size();
+        return {data, name.size()};
+    }
+
+    static std::uint64_t load64(const char *p)
+    {
+        std::uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static std::uint32_t load32(const char *p)
+    {
+        std::uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static std::uint32_t hash(std::string_view name)
+    {
+        // Names are mostly short: up to 16 bytes are covered by two possibly
+        // overlapping loads, without a byte loop or variable-length copy
+        constexpr std::uint64_t k = 0x9e3779b97f4a7c15ull;
+        const char *p = name.data();
+        std::size_t n = name.size();
+
+        std::uint64_t lo, hi;
+        if (n >= 8)
+        {
+            lo = load64(p);
+            hi = load64(p + n - 8);
+            for (std::size_t i = 8; i + 8 < n; i += 8)
+            {
+                lo = (lo ^ load64(p + i)) * k;
+            }
+        }
+        else if (n >= 4)
+        {
+            lo = load32(p);
+            hi = load32(p + n - 4);
+        }
+        else
+        {
+            lo = n ? static_cast<unsigned char>(p[0]) : 0;
+            hi = n ? (static_cast<unsigned char>(p[n / 2]) << 8) | static_cast<unsigned char>(p[n - 1]) : 0;
+        }
+
+        // Multiplying only carries bits upwards, fold the high half back down
+        std::uint64_t h = (lo ^ (n * k)) * k ^ hi;
+        h = (h ^ (h >> 32)) * k;
+        return static_cast<std::uint32_t>(h >> 32);
+    }
+
+    void grow()
+    {
+        std::vector<Slot> old = std::move(this->slots);
+        this->slots.assign(old.size() * 2, Slot{0, empty_slot});
+
+        std::size_t mask = this->slots.size() - 1;
+        for (const Slot &slot : old)
+        {
+            if (slot.id == empty_slot)
+                continue;
+
+            std::size_t i = slot.hash & mask;
+            while (this->slots[i].id != empty_slot)
+                i = (i + 1) & mask;
+            this->slots[i] = slot;
+        }
+    }
+
+public:
+    SymbolId intern(std::string_view name)
+    {
+        std::uint32_t h = hash(name);
+        std::size_t mask = this->slots.size() - 1;
+
+        for (std::size_t i = h & mask;; i = (i + 1) & mask)
+        {
+            Slot &slot = this->slots[i];
+            if (slot.id == empty_slot)
+            {
+                // Keep the load factor under one half
+                if ((this->names.size() + 1) * 2 > this->slots.size())
+                {
+                    this->grow();
+                    return this->intern(name);
+                }
+
+                slot = {h, static_cast<SymbolId>(this->names.size())};
+                this->names.push_back(this->store(name));
+                return slot.id;
+            }
+            if (slot.hash == h && this->names[slot.id] == name)
+            {
+                return slot.id;
+            }
+        }
+    }
+
+    std::string_view get_name(SymbolId id) const
+    {
+        return this->names[id];
+    }
+
+    std::size_t size() const
+    {
+        return this->names.size();
+    }
+};
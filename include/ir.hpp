@@ -0,0 +1,207 @@
+#pragma once
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "interner.hpp"
+#include "types.hpp"
+
+struct FunctionInstance;
+
+// Mid-level IR between the AST and QBE. A function is a list of basic blocks
+// in SSA form: every value is a parameter or the result of exactly one
+// instruction, and is named by a dense id per function. Where paths join,
+// phis pick the value that arrived.
+
+using ValueId = std::uint32_t;
+using BlockId = std::uint32_t;
+
+struct IROperand
+{
+    enum Kind : std::uint8_t
+    {
+        None,
+        Value,  // SSA value, id
+        Int,    // immediate, bits
+        Float,  // immediate, bits of the double
+        Global, // address of the global with symbol id
+        Ready,  // address of the lazy init flag of the global with symbol id
+        String, // address of string constant id
+    };
+
+    Kind kind = None;
+    std::uint32_t id = 0;
+    std::uint64_t bits = 0;
+
+    static IROperand value(ValueId id)
+    {
+        return {Value, id, 0};
+    }
+
+    static IROperand constant(long value)
+    {
+        return {Int, 0, static_cast<std::uint64_t>(value)};
+    }
+
+    static IROperand constant(double value)
+    {
+        return {Float, 0, std::bit_cast<std::uint64_t>(value)};
+    }
+
+    bool is_constant() const
+    {
+        return this->kind == Int || this->kind == Float;
+    }
+
+    bool operator==(const IROperand &) const = default;
+};
+
+enum class Opcode : std::uint8_t
+{
+    Copy,       // a
+    Add,        // a, b
+    Sub,        // a, b
+    Mul,        // a, b
+    Div,        // a, b
+    Shl,        // a shifted left by b
+    Sar,        // a shifted right by b, copying the sign bit
+    Shr,        // a shifted right by b, filling with zeros
+    And,        // a, b
+    Ne,         // a, b; 1 if they differ, else 0
+    IntToFloat, // a
+    FloatToInt, // a
+    Load,       // from address a
+    Store,      // a to address b, type is the stored value's
+    Get,        // value of lazy global a, initializing it on first use
+    Call,       // callee with arguments
+    Phi,        // one argument per predecessor of its block, in their order
+};
+
+struct IRInstruction
+{
+    static constexpr std::uint32_t none = UINT32_MAX;
+
+    Opcode op;
+    Type type = Type::Void; // of the result, Void if there is none
+    ValueId result = none;
+    IROperand a = {};
+    IROperand b = {};
+
+    // Calls go to an instance defined here or by name to outside code.
+    // Arguments are a range of IRFunction::arguments, the ones from variadic
+    // on are passed after `...`. Phis keep their arguments there too.
+    const FunctionInstance *callee = nullptr;
+    std::string_view name = {};
+    std::uint32_t first_arg = 0;
+    std::uint32_t arg_count = 0;
+    std::uint32_t variadic = none;
+
+    // Loads and stores of globals no function writes, and calls that
+    // neither have effects nor depend on anything but their arguments
+    bool invariant = false;
+
+    // Calls that may write globals
+    bool clobbers = false;
+};
+
+struct IRBlock
+{
+    enum class Exit : std::uint8_t
+    {
+        Return, // value, if any
+        Jump,   // to target
+        Branch, // to target if value isn't zero, else to otherwise
+    };
+
+    // Phis run first, all at once
+    std::vector<IRInstruction> phis;
+    std::vector<IRInstruction> instructions;
+    std::vector<BlockId> predecessors;
+
+    Exit exit = Exit::Return;
+    IROperand value;
+    BlockId target = 0;
+    BlockId otherwise = 0;
+};
+
+struct IRFunction
+{
+    std::string name; // without the $
+    bool exported = false;
+    Type result = Type::Void;
+
+    // Parameters are the first values, named after their symbol
+    std::vector<SymbolId> params;
+    std::vector<Type> value_types;
+
+    // blocks[0] is the entry
+    std::vector<IRBlock> blocks;
+    std::vector<IROperand> arguments;
+
+    ValueId new_value(Type type)
+    {
+        this->value_types.push_back(type);
+        return static_cast<ValueId>(this->value_types.size() - 1);
+    }
+
+    BlockId new_block()
+    {
+        this->blocks.emplace_back();
+        return static_cast<BlockId>(this->blocks.size() - 1);
+    }
+
+    Type type_of(IROperand operand) const
+    {
+        switch (operand.kind)
+        {
+        case IROperand::Value:
+            return this->value_types[operand.id];
+        case IROperand::Int:
+            return Type::Int;
+        case IROperand::Float:
+            return Type::Float;
+        case IROperand::None:
+            return Type::Void;
+        default:
+            return Type::String;
+        }
+    }
+};
+
+// A double as a QBE literal, exact to the last bit
+inline std::string float_literal(double value)
+{
+    char buffer[32];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    return "d_" + std::string(buffer, end - buffer);
+}
+
+// Static data, emitted as is
+struct IRData
+{
+    enum class Section : std::uint8_t
+    {
+        Data,
+        ReadOnly, // .rodata
+        RelRo,    // .data.rel.ro, for read-only addresses that need relocating
+    };
+
+    std::string name; // without the $
+    Section section = Section::Data;
+    std::string contents;
+};
+
+struct IRModule
+{
+    std::vector<IRData> data;
+    std::vector<IRFunction> functions;
+
+    // String constants by id, emitted after the code
+    std::vector<std::string> strings;
+
+    // Names calls refer to, which have to stay put
+    std::deque<std::string> names;
+};
@@ -0,0 +1,138 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "dead_code.hpp"
+#include "global_analysis.hpp"
+#include "inliner.hpp"
+#include "ir.hpp"
+#include "scope_stack.hpp"
+#include "source_manager.hpp"
+#include "type_inference.hpp"
+
+// Lowers the checked AST to IR.
+//
+// Every reachable function instance becomes a function, calls of inlined
+// functions are expanded in place, lazy globals get a getter and the real
+// `main` runs the startup initializers before the user's main. Lowering is
+// literal: every read of a global loads it and every let copies its value,
+// cleaning that up is left to the passes. A function that returns a call of
+// itself loops instead: the call reassigns the parameters and jumps back to
+// the block after the entry, so the recursion runs in constant stack space.
+//
+// Locals are variables, which are put in SSA form as the code is lowered,
+// after Braun et al., "Simple and Efficient Construction of Static Single
+// Assignment Form": a read looks for the variable's value in the current
+// block and its predecessors, and places a phi where several of them meet.
+// A block whose predecessors aren't all known yet, like a loop header, gets
+// phis without arguments until it is sealed. Phis that turn out to merge a
+// single value are removed once the function is done.
+class IRLowering
+{
+    IRModule &module;
+    const SourceManager &sources;
+    const StringInterner &symbols;
+    const TypeInference &types;
+    const GlobalAnalysis &globals;
+    const DeadCodeEliminator &reachable;
+    const Inliner &inliner;
+
+    using VariableId = std::uint32_t;
+    static constexpr VariableId no_variable = UINT32_MAX;
+    static constexpr BlockId no_block = UINT32_MAX;
+
+    // Function and block instructions are appended to, no_block once the
+    // code that follows can't be reached
+    IRFunction *fn = nullptr;
+    BlockId block = 0;
+
+    // Where self calls in tail position of the instance being lowered jump
+    // to, no_block if it has none
+    const FunctionInstance *instance = nullptr;
+    BlockId tail_target = no_block;
+    std::vector<VariableId> param_variables;
+
+    // Name resolution is indexed by symbol id, locals live in nested scopes.
+    // Lets of locals bound at or above function_depth but outside the
+    // current scope assign them.
+    ScopeStack<VariableId> locals;
+    std::size_t function_depth = 0;
+
+    // SSA construction state of the function being lowered
+    std::vector<Type> variable_types;
+    std::unordered_map<std::uint64_t, IROperand> definitions; // by variable and block
+    std::vector<bool> sealed;
+    std::vector<std::vector<std::pair<VariableId, std::size_t>>> incomplete; // phis by block
+    std::vector<IROperand> replaced;                                         // trivial phis by value
+
+    // Explicit stacks for lower_expr, reused between expressions
+    std::vector<std::pair<const Expr *, bool>> work;
+    std::vector<IROperand> values;
+    std::vector<Type> arg_types;
+
+    // Name of every instance that has been called or lowered, by instance
+    std::vector<std::string_view> instance_names;
+
+    // Equal strings share one constant
+    std::unordered_map<std::string, std::uint32_t> string_ids;
+
+    void begin_function(std::string name, Type result);
+    void finish_function();
+    BlockId new_block();
+    void jump(BlockId to);
+    void branch(IROperand condition, BlockId then_block, BlockId else_block);
+
+    VariableId new_variable(Type type);
+    void write_variable(VariableId variable, BlockId block, IROperand value);
+    IROperand read_variable(VariableId variable, BlockId block);
+    IROperand read_variable_recursive(VariableId variable, BlockId block);
+    IROperand add_phi_operands(VariableId variable, BlockId block, std::size_t phi);
+    IROperand remove_trivial_phi(BlockId block, std::size_t phi);
+    void seal(BlockId block);
+    IROperand resolve(IROperand operand) const;
+
+    IROperand emit(IRInstruction inst);
+    IROperand emit(Opcode op, Type type, IROperand a, IROperand b = {});
+    IROperand emit_call(IRInstruction call, std::span<const IROperand> args);
+
+    IROperand string_constant(std::string_view text);
+
+    // Ints are the only values that convert implicitly, to floats
+    IROperand convert(IROperand value, Type type);
+
+    std::string_view function_name(const FunctionInstance *instance);
+    std::string global_data(const LetStmt *let);
+
+    void lower_function(const FunctionInstance *instance);
+    void lower_lazy_global(const LetStmt *let);
+    void lower_entry(const std::vector<const LetStmt *> &startup, const FunctionInstance *user_main);
+
+    // Lower statements into the current block, stopping where they return.
+    // Nested blocks get a scope of their own.
+    void lower_block(std::span<Stmt *const> statements, Type result);
+    void lower_scoped(std::span<Stmt *const> statements, Type result);
+    void lower_if(const IfStmt *ifs, Type result);
+    void lower_while(const WhileStmt *loop, Type result);
+    void lower_let(const LetStmt *let);
+    void lower_tail_call(const CallExpr *call);
+
+    // A w that is 1 where value isn't zero, or a constant if value is one
+    IROperand lower_condition(const Expr *condition);
+
+    IROperand lower_expr(const Expr *root);
+    IROperand lower_identifier(const IdentifierExpr *ident);
+    IROperand lower_binary(const BinaryExpr *bin, IROperand lhs, IROperand rhs);
+    IROperand lower_call(const CallExpr *call, std::span<const IROperand> args);
+    IROperand lower_inline(const FunctionInstance *callee, std::span<const IROperand> args);
+
+    [[noreturn]] void error(const Expr *expr, const std::string &message) const;
+
+public:
+    IRLowering(IRModule &module, const SourceManager &sources, const StringInterner &symbols,
+               const TypeInference &types, const GlobalAnalysis &globals, const DeadCodeEliminator &reachable,
+               const Inliner &inliner)
+        : module(module), sources(sources), symbols(symbols), types(types), globals(globals), reachable(reachable),
+          inliner(inliner), locals(symbols.size(), no_variable), instance_names(types.instance_count()) {}
+
+    void lower_program(const std::vector<Stmt *> &program);
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include <span>
+#include <string_view>
+#include <vector>
+#include "ir.hpp"
+
+// Passes rewrite one function in place and keep it in SSA form
+
+// Replace copies by the value they copy, and phis that merge a single value
+// by it
+void propagate_copies(IRFunction &fn);
+
+// Apply algebraic identities like x*1 and x-x, rebalance chains of integer
+// adds and multiplies into trees so their operations can run in parallel,
+// and replace multiplies and divides by constants with shifts and cheaper
+// multiplies
+void simplify_arithmetic(IRFunction &fn);
+
+// Reuse the values of equal computations and fold constants within each
+// block. Loads reuse what the block last loaded or stored at the address.
+void eliminate_common_subexpressions(IRFunction &fn);
+
+// Like eliminate_common_subexpressions, but a value is also reused in every
+// block its definition dominates
+void number_values(IRFunction &fn);
+
+// Drop instructions without effects whose result is never used
+void eliminate_dead_code(IRFunction &fn);
+
+// One forward sweep that replaces copies by what they copy and operations
+// on constants by their value, and drops them. The only cleanup -O0 gets.
+void clean_up(IRFunction &fn);
+
+// Move computations that give the same value on every iteration of a loop,
+// and can't trap, to the block before it
+void hoist_loop_invariants(IRFunction &fn);
+
+// Runs the passes of an optimization level over every function
+class PassManager
+{
+public:
+    struct Pass
+    {
+        std::string_view name;
+        void (*run)(IRFunction &fn);
+    };
+
+    static constexpr Pass passes[] = {
+        {"copyprop", propagate_copies},
+        {"simplify", simplify_arithmetic},
+        {"cse", eliminate_common_subexpressions},
+        {"gvn", number_values},
+        {"licm", hoist_loop_invariants},
+        {"dce", eliminate_dead_code},
+        {"peephole", clean_up},
+    };
+
+private:
+    std::vector<Pass> pipeline;
+
+public:
+    // -O0 only runs the peephole cleanup, -O1 cleans up each block and -O2 works across blocks
+    // and hoists loop invariants
+    explicit PassManager(int level);
+
+    // Whether name is a pass --dump-ir-after accepts, "lower" is the IR
+    // before any pass
+    static bool is_pass(std::string_view name);
+
+    // Run the pipeline, calling after(name) once each pass is done with every
+    // function and after("lower") first
+    template <typename After>
+    void run(IRModule &module, After &&after) const
+    {
+        after(std::string_view("lower"));
+        for (const Pass &pass : this->pipeline)
+        {
+            for (IRFunction &fn : module.functions)
+            {
+                pass.run(fn);
+            }
+            after(pass.name);
+        }
+    }
+};
@@ -1,52 +1,72 @@
 #pragma once
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_set>
 #include <iostream>
-
-enum class TokenType
-{
-    // Basic types
-    Integer,
-    Float,
-    Identifier,
-    // Keywords
-    String,
-    Symbol,
-    // Other
-    Keyword,
-};
-
-struct Token
-{
-    TokenType type;
-    std::string value;
-    int line;
-    int column;
-};
+#include "source_manager.hpp"
+#include "token.hpp"
+#include "scanner.hpp"
+#include "lexer_tables.hpp"
 
 class Lexer
 {
 public:
-    Lexer(const std::string &file_name, const std::string &input) : file_name(file_name), src(input), pos(0), line(1), col(1) {}
+    Lexer(const SourceManager &sources, FileId file)
+        : sources(sources), file(file), src(sources.get_contents(file)), pos(0), limit(src.size()) {}
 
+    // Lex the whole input at once
     std::vector<Token> tokenize();
 
+    // Same result as tokenize(), but large inputs are split into chunks that
+    // are lexed on up to `threads` worker threads. The literal payloads end up
+    // in get_literals() just like with tokenize().
+    std::vector<Token> tokenize_parallel(unsigned threads);
+
+    // Lex a single token. Returns false once the input is exhausted.
+    bool next(Token &token);
+
+    // Payload of the last numeric token returned by next()
+    const LiteralValue &get_literal() const
+    {
+        return this->literal;
+    }
+
+    // Payloads of the numeric literals seen by tokenize(), in token order
+    std::vector<LiteralValue> &get_literals()
+    {
+        return this->literals;
+    }
+
+    std::string_view text(const Token &token) const
+    {
+        return this->src.substr(token.offset, token.length);
+    }
+
     static std::string token_type_to_string(TokenType type);
 
     void print_tokens(const std::vector<Token> &tokens);
 
 private:
-    std::string file_name;
-    std::string src;
+    const SourceManager &sources;
+    FileId file;
+    std::string_view src;
     std::size_t pos;
-    int line, col;
 
-    const std::unordered_set<std::string> keywords = {
-        "let", "print", "if", "else", "while", "fn", "return"};
+    // No new token is started at or past this position
+    std::size_t limit;
+
+    // Speculative lexers run on worker threads and may have started in the
+    // middle of a string literal, so errors are reported back instead of
+    // exiting
+    bool speculative = false;
+    struct SpeculationFailed
+    {
+    };
 
-    const std::unordered_set<char> symbols = {
-        '=', '+', '-', '*', '/', '(', ')', '{', '}', ';', ','};
+    std::vector<LiteralValue> literals;
+    LiteralValue literal{};
+    const ScanKernels &scan = get_scan_kernels();
 
     char peek() const;
 
@@ -56,10 +76,28 @@ private:
 
     bool eof() const;
 
+    // Move pos to the given pointer into src
+    void jump_to(const char *p)
+    {
+        this->pos = p - this->src.data();
+    }
+
+    const char *cursor() const
+    {
+        return this->src.data() + this->pos;
+    }
+
+    const char *src_end() const
+    {
+        return this->src.data() + this->src.size();
+    }
+
     bool is_whitespace(char c) const;
 
     bool is_symbol(char c) const;
 
+    void parse_literal(const Token &token);
+
     Token make_number();
 
     Token make_indentifier_or_keyword();
@@ -68,15 +106,21 @@ private:
 
     Token make_symbol()
     {
-        int start_col = col;
+        std::uint32_t start = this->pos;
         char c = this->advance();
-        return {TokenType::Symbol, std::string(1, c), this->line, start_col};
+        return {symbol_kinds[static_cast<unsigned char>(c)], start, 1};
     }
 
     void error(const std::string &message) const
     {
+        if (this->speculative)
+        {
+            throw SpeculationFailed{};
+        }
+
         char c = this->peek();
-        std::cerr << "[LEXER] " << this->file_name << ":" << this->line << ":" << this->col
+        PresumedLocation loc = this->sources.resolve(this->sources.get_base(this->file) + this->pos);
+        std::cerr << "[LEXER] " << loc.file_name << ":" << loc.line << ":" << loc.column
                   << ": " << message
                   << " '" << c << "' (ASCII: " << static_cast<int>(static_cast<unsigned char>(c)) << ")"
                   << std::endl;
@@ -0,0 +1,160 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include "token.hpp"
+
+// Everything the lexer needs to classify characters and keywords, computed at
+// compile time. Adding a keyword or symbol only means giving it a TokenType
+// and an entry in the lists below.
+
+struct KeywordEntry
+{
+    std::string_view text;
+    TokenType type;
+};
+
+struct SymbolEntry
+{
+    char c;
+    TokenType type;
+};
+
+constexpr std::array<KeywordEntry, 7> keyword_list = {{
+    {"let", TokenType::Let},
+    {"print", TokenType::Print},
+    {"if", TokenType::If},
+    {"else", TokenType::Else},
+    {"while", TokenType::While},
+    {"fn", TokenType::Fn},
+    {"return", TokenType::Return},
+}};
+
+constexpr std::array<SymbolEntry, 12> symbol_list = {{
+    {'=', TokenType::Equal},
+    {'+', TokenType::Plus},
+    {'-', TokenType::Minus},
+    {'*', TokenType::Star},
+    {'/', TokenType::Slash},
+    {'(', TokenType::LeftParen},
+    {')', TokenType::RightParen},
+    {'{', TokenType::LeftBrace},
+    {'}', TokenType::RightBrace},
+    {';', TokenType::Semicolon},
+    {',', TokenType::Comma},
+    {'@', TokenType::At},
+}};
+
+enum CharClass : std::uint8_t
+{
+    CharSpace = 1 << 0,
+    CharDigit = 1 << 1,
+    CharIdentStart = 1 << 2, // [A-Za-z_]
+    CharIdentPart = 1 << 3,  // [A-Za-z0-9_]
+    CharSymbol = 1 << 4,
+};
+
+constexpr std::array<std::uint8_t, 256> build_char_classes()
+{
+    std::array<std::uint8_t, 256> table{};
+
+    for (unsigned char c : std::string_view(" \t\n\r"))
+        table[c] |= CharSpace;
+
+    for (int c = '0'; c <= '9'; ++c)
+        table[c] |= CharDigit | CharIdentPart;
+
+    for (int c = 'a'; c <= 'z'; ++c)
+    {
+        table[c] |= CharIdentStart | CharIdentPart;
+        table[c - 'a' + 'A'] |= CharIdentStart | CharIdentPart;
+    }
+    table['_'] |= CharIdentStart | CharIdentPart;
+
+    for (const auto &symbol : symbol_list)
+        table[static_cast<unsigned char>(symbol.c)] |= CharSymbol;
+
+    return table;
+}
+
+constexpr std::array<std::uint8_t, 256> char_classes = build_char_classes();
+
+constexpr bool has_char_class(char c, std::uint8_t cls)
+{
+    return char_classes[static_cast<unsigned char>(c)] & cls;
+}
+
+// Token kind of each symbol character, only meaningful where CharSymbol is set
+constexpr std::array<TokenType, 256> build_symbol_kinds()
+{
+    std::array<TokenType, 256> table{};
+    for (const auto &symbol : symbol_list)
+        table[static_cast<unsigned char>(symbol.c)] = symbol.type;
+    return table;
+}
+
+constexpr std::array<TokenType, 256> symbol_kinds = build_symbol_kinds();
+
+// Keywords are found through a perfect hash over the first byte, last byte and
+// length. The multiplier is searched for at compile time so that every keyword
+// lands in its own slot.
+constexpr std::size_t keyword_slots = 64;
+
+constexpr std::size_t keyword_hash(std::string_view word, std::uint32_t seed)
+{
+    auto first = static_cast<unsigned char>(word.front());
+    auto last = static_cast<unsigned char>(word.back());
+    return (first * seed + last * 31 + word.size()) % keyword_slots;
+}
+
+constexpr std::uint32_t find_keyword_seed()
+{
+    for (std::uint32_t seed = 1; seed < 100000; ++seed)
+    {
+        std::array<bool, keyword_slots> used{};
+        bool ok = true;
+        for (const auto &keyword : keyword_list)
+        {
+            auto slot = keyword_hash(keyword.text, seed);
+            if (used[slot])
+            {
+                ok = false;
+                break;
+            }
+            used[slot] = true;
+        }
+        if (ok)
+            return seed;
+    }
+    return 0;
+}
+
+constexpr std::uint32_t keyword_seed = find_keyword_seed();
+static_assert(keyword_seed != 0, "No perfect hash found for keyword_list, grow keyword_slots");
+
+// Slot -> index into keyword_list + 1, 0 marks an empty slot
+constexpr std::array<std::uint8_t, keyword_slots> build_keyword_table()
+{
+    std::array<std::uint8_t, keyword_slots> table{};
+    for (std::size_t i = 0; i < keyword_list.size(); ++i)
+        table[keyword_hash(keyword_list[i].text, keyword_seed)] = static_cast<std::uint8_t>(i + 1);
+    return table;
+}
+
+constexpr std::array<std::uint8_t, keyword_slots> keyword_table = build_keyword_table();
+
+// Token kind of a keyword, or Identifier if word is not a keyword
+constexpr TokenType find_keyword(std::string_view word)
+{
+    if (word.empty())
+        return TokenType::Identifier;
+
+    std::uint8_t entry = keyword_table[keyword_hash(word, keyword_seed)];
+    if (entry == 0 || keyword_list[entry - 1].text != word)
+        return TokenType::Identifier;
+
+    return keyword_list[entry - 1].type;
+}
+
+static_assert(find_keyword("return") == TokenType::Return);
+static_assert(find_keyword("returns") == TokenType::Identifier && find_keyword("lot") == TokenType::Identifier);
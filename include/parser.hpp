@@ -1,63 +1,142 @@
 #pragma once
-#include <memory>
+#include <string_view>
 #include "lexer.hpp"
+#include "ast_arena.hpp"
+#include "token_stream.hpp"
 #include "expr.hpp"
 #include "stmt.hpp"
 
 class Parser
 {
-    std::string file_name;
-    const std::vector<Token> tokens;
-    std::size_t pos = 0;
+    const SourceManager &sources;
+    FileId file;
+    std::string_view src;
+    TokenStream tokens;
+    AstArena &arena;
+
+    // Every name is interned here as it is parsed
+    StringInterner &symbols;
+
+    // Set for the slice parsers of parse_parallel. They intern into a private
+    // table and remember where each id was stored, to remap it after merging.
+    std::vector<SymbolId *> *symbol_refs = nullptr;
+
+    // Speculative parsers run on worker threads over a slice of the program,
+    // so errors are reported back instead of exiting
+    bool speculative = false;
+    struct ParseFailed
+    {
+    };
+
+    // Children of the nodes currently being parsed. Nested lists push on top
+    // and are copied into the arena once complete.
+    std::vector<Expr *> expr_scratch;
+    std::vector<Stmt *> stmt_scratch;
 
 public:
-    Parser(std::string file_name, std::vector<Token> tokens) : file_name(std::move(file_name)), tokens(std::move(tokens)) {}
+    // Nodes are allocated in arena, which has to outlive the returned program
+    Parser(const SourceManager &sources, FileId file, Lexer &lexer, AstArena &arena, StringInterner &symbols)
+        : sources(sources), file(file), src(sources.get_contents(file)), tokens(lexer), arena(arena), symbols(symbols) {}
+
+    // Parse tokens that were lexed up front. Both vectors have to outlive the parser.
+    Parser(const SourceManager &sources, FileId file, const std::vector<Token> &tokens,
+           const std::vector<LiteralValue> &literals, AstArena &arena, StringInterner &symbols)
+        : sources(sources), file(file), src(sources.get_contents(file)), tokens(tokens, literals), arena(arena), symbols(symbols) {}
+
+    // Parse pre-lexed tokens with the top-level declarations spread over up to
+    // `threads` threads, 0 meaning every core. Returns the same program as
+    // parse_program() and reports the same first error.
+    static std::vector<Stmt *> parse_parallel(const SourceManager &sources, FileId file, const std::vector<Token> &tokens,
+                                              const std::vector<LiteralValue> &literals, AstArena &arena,
+                                              StringInterner &symbols, unsigned threads);
 
 private:
-    // Get current token and advance to next
-    const Token &advance()
+    // Parse tokens [token_begin, token_end) of a pre-lexed program
+    Parser(const SourceManager &sources, FileId file, const std::vector<Token> &tokens,
+           const std::vector<LiteralValue> &literals, std::size_t token_begin, std::size_t token_end,
+           std::size_t literal_begin, AstArena &arena, StringInterner &symbols)
+        : sources(sources), file(file), src(sources.get_contents(file)),
+          tokens(tokens, literals, token_begin, token_end, literal_begin), arena(arena), symbols(symbols) {}
+
+    SymbolId intern(std::string_view name)
+    {
+        return this->symbols.intern(name);
+    }
+
+    // Record where a symbol id was stored, see symbol_refs
+    void track(SymbolId &symbol)
     {
-        if (!this->is_at_end())
+        if (this->symbol_refs)
         {
-            return this->tokens[this->pos++];
+            this->symbol_refs->push_back(&symbol);
         }
+    }
 
-        return this->tokens.back();
+    template <typename Node>
+    Node *track(Node *node)
+    {
+        this->track(node->symbol);
+        return node;
+    }
+
+    // Get the source text of a token
+    std::string_view text(const Token &token) const
+    {
+        return this->src.substr(token.offset, token.length);
+    }
+
+    // Get the global source location of a token
+    SourceLocation loc(const Token &token) const
+    {
+        return this->sources.get_base(this->file) + token.offset;
+    }
+
+    // Get current token and advance to next.
+    // Returned by value, the stream reuses its slots as it moves on.
+    Token advance()
+    {
+        return this->tokens.advance();
     }
 
     // Get current token
     const Token &peek() const
     {
-        return this->tokens[this->pos];
+        return this->tokens.peek();
     }
 
     // Check if all tokens have been used up
     bool is_at_end() const
     {
-        return this->pos >= this->tokens.size();
+        return this->tokens.is_at_end();
     }
 
     // Get previous token
     const Token &previous() const
     {
-        return this->tokens[this->pos - 1];
+        return this->tokens.previous();
     }
 
-    // Check if token is of given type and value
-    bool check(TokenType type, const std::string &val = "") const
+    // Get the payload of the previous token, which must be a number
+    const LiteralValue &previous_literal() const
+    {
+        return this->tokens.previous_literal();
+    }
+
+    // Check if token is of given type
+    bool check(TokenType type) const
     {
         if (this->is_at_end())
         {
             return false;
         }
 
-        return this->peek().type == type && (val.empty() || this->peek().value == val);
+        return this->peek().type == type;
     }
 
     // Check current token and move on to next
-    bool match(TokenType type, const std::string &val = "")
+    bool match(TokenType type)
     {
-        if (this->check(type, val))
+        if (this->check(type))
         {
             this->advance();
             return true;
@@ -65,182 +144,333 @@ private:
         return false;
     }
 
-    // Check if current token is of given type and value.
+    // Check if current token is of given type.
     // Advance if true.
     // Error out if false.
-    const Token &consume(TokenType type, const std::string &val, const std::string &msg)
-    {
-        if (this->check(type, val))
-        {
-            return this->advance();
-        }
-        this->error(msg + " at line " + std::to_string(this->peek().line));
-    }
-
-    // Same as previously.
-    // Check if current token is of given type only.
-    const Token &consume(TokenType type, const std::string &msg)
+    Token consume(TokenType type, const std::string &msg)
     {
         if (this->check(type))
         {
             return this->advance();
         }
-        this->error(msg + " at line " + std::to_string(this->peek().line));
+        this->error(msg + " at line " + std::to_string(this->sources.resolve(this->loc(this->peek())).line));
     }
 
-    int get_precedence(const std::string &op)
+    int get_precedence(TokenType op)
     {
-        if (op == "+" || op == "-")
+        switch (op)
         {
+        case TokenType::Plus:
+        case TokenType::Minus:
             return 10;
-        }
-        if (op == "*" || op == "/")
-        {
+        case TokenType::Star:
+        case TokenType::Slash:
             return 20;
+        default:
+            return 0;
         }
-        return 0;
     }
 
-    std::unique_ptr<Expr> parse_expression(int precedence = 0)
+    // Move the last `count` entries of a scratch stack into the arena
+    template <typename T>
+    std::span<T> pop_scratch(std::vector<T> &scratch, std::size_t base)
+    {
+        auto items = this->arena.copy_array(scratch.data() + base, scratch.size() - base);
+        scratch.resize(base);
+        return items;
+    }
+
+    // An expression that is still open: the whole expression, a parenthesized
+    // group or the argument list of a call
+    struct ExprFrame
+    {
+        enum Kind
+        {
+            Top,
+            Group,
+            Call,
+        } kind;
+
+        // Operands and operators of this frame start at these stack depths
+        std::size_t operand_base;
+        std::size_t operator_base;
+
+        // Call frames collect finished arguments on expr_scratch
+        std::size_t argument_base = 0;
+        std::string_view name = {};
+        SymbolId symbol = 0;
+        bool tail = false;
+    };
+
+    // Explicit stacks for parse_expression, reused between expressions
+    std::vector<ExprFrame> expr_frames;
+    std::vector<Expr *> operands;
+    std::vector<Token> operators;
+
+    // Pratt parser driven by explicit stacks instead of recursion, so deeply
+    // nested or very long expressions can't overflow the native stack.
+    // Operators wait on the operator stack until one of lower or equal
+    // precedence shows up, which keeps binary operators left associative.
+    Expr *parse_expression()
     {
-        auto left = this->parse_nud(); // Null denotation
+        this->expr_frames.push_back({ExprFrame::Top, this->operands.size(), this->operators.size()});
 
-        while (!this->is_at_end() && this->peek().type == TokenType::Symbol && this->get_precedence(this->peek().value) > precedence)
+        bool expect_operand = true;
+        while (true)
         {
-            std::string op = this->advance().value;
-            left = this->parse_led(std::move(left), op); // Left denotation
+            // Null denotation: prefixes open frames, anything else is an operand
+            if (expect_operand)
+            {
+                expect_operand = !this->parse_nud();
+                continue;
+            }
+
+            // Left denotation: binary operators, applied lazily
+            if (!this->is_at_end() && this->get_precedence(this->peek().type) > 0)
+            {
+                int precedence = this->get_precedence(this->peek().type);
+                while (this->operators.size() > this->expr_frames.back().operator_base &&
+                       this->get_precedence(this->operators.back().type) >= precedence)
+                {
+                    this->reduce();
+                }
+                this->operators.push_back(this->advance());
+                expect_operand = true;
+                continue;
+            }
+
+            // Nothing follows the operand, so the innermost frame is complete
+            while (this->operators.size() > this->expr_frames.back().operator_base)
+            {
+                this->reduce();
+            }
+            if (this->expr_frames.back().kind == ExprFrame::Top)
+            {
+                this->expr_frames.pop_back();
+                break;
+            }
+            expect_operand = this->close_frame();
         }
 
-        return left;
+        Expr *expr = this->operands.back();
+        this->operands.pop_back();
+        return expr;
     }
 
-    std::unique_ptr<Expr> parse_nud()
+    // Push an operand and return true, or open a frame and return false
+    bool parse_nud()
     {
         if (match(TokenType::Integer))
         {
-            return std::make_unique<IntExpr>(std::stoi(previous().value), previous().line);
+            operands.push_back(arena.make<IntExpr>(previous_literal().integer, loc(previous())));
+            return true;
         }
         if (match(TokenType::Float))
         {
-            return std::make_unique<FloatExpr>(std::stof(previous().value), previous().line);
+            operands.push_back(arena.make<FloatExpr>(previous_literal().floating, loc(previous())));
+            return true;
         }
         if (match(TokenType::String))
         {
-            return std::make_unique<StringExpr>(previous().value, previous().line);
+            operands.push_back(arena.make<StringExpr>(text(previous()), loc(previous())));
+            return true;
         }
         if (match(TokenType::Identifier))
         {
-            std::string name = previous().value;
+            std::string_view name = text(previous());
 
             // Function call
-            if (match(TokenType::Symbol, "("))
-            {
-                std::vector<std::unique_ptr<Expr>> args;
-                if (!check(TokenType::Symbol, ")"))
-                {
-                    do
-                    {
-                        args.push_back(parse_expression());
-                    } while (match(TokenType::Symbol, ","));
-                }
-                consume(TokenType::Symbol, ")", "Expected ')' after function arguments");
-                return std::make_unique<CallExpr>(name, std::move(args), previous().line);
-            }
+            if (match(TokenType::LeftParen))
+                return this->open_call(name, false);
 
-            return std::make_unique<IdentifierExpr>(name, previous().line);
+            operands.push_back(track(arena.make<IdentifierExpr>(name, intern(name), loc(previous()))));
+            return true;
+        }
+        if (match(TokenType::At))
+        {
+            // @tail is the only attribute and applies to the call after it
+            std::string_view attribute = text(consume(TokenType::Identifier, "Expected attribute name after '@'"));
+            if (attribute != "tail")
+                this->error("Unknown attribute: @" + std::string(attribute));
+            std::string_view name = text(consume(TokenType::Identifier, "Expected a call after @tail"));
+            consume(TokenType::LeftParen, "Expected a call after @tail");
+            return this->open_call(name, true);
         }
-        if (match(TokenType::Symbol, "("))
+        if (match(TokenType::LeftParen))
         {
-            auto expr = parse_expression();
-            consume(TokenType::Symbol, ")", "Expected ')'");
-            return expr;
+            expr_frames.push_back({ExprFrame::Group, operands.size(), operators.size()});
+            return false;
         }
 
-        this->error("Unexpected token in expression: " + peek().value);
+        this->error("Unexpected token in expression: " + std::string(text(peek())));
     }
 
-    std::unique_ptr<Expr> parse_led(std::unique_ptr<Expr> left, const std::string &op)
+    // Called once the '(' after the name is consumed
+    bool open_call(std::string_view name, bool tail)
     {
-        int precedence = get_precedence(op);
-        auto right = parse_expression(precedence);
-        return std::make_unique<BinaryExpr>(std::move(left), op, std::move(right), previous().line);
+        if (match(TokenType::RightParen))
+        {
+            operands.push_back(track(arena.make<CallExpr>(name, intern(name), std::span<Expr *>(), loc(previous()), tail)));
+            return true;
+        }
+        expr_frames.push_back({ExprFrame::Call, operands.size(), operators.size(), expr_scratch.size(), name, intern(name), tail});
+        return false;
     }
 
-    std::unique_ptr<Stmt> parse_function()
+    // Combine the top operator with its two operands
+    void reduce()
     {
-        std::string name = consume(TokenType::Identifier, "Expected function name").value;
-        consume(TokenType::Symbol, "(", "Expected '(' after function name");
+        Token op = this->operators.back();
+        this->operators.pop_back();
+        Expr *right = this->operands.back();
+        this->operands.pop_back();
+        Expr *left = this->operands.back();
+        this->operands.back() = arena.make<BinaryExpr>(left, text(op), right, loc(previous()));
+    }
 
-        std::vector<std::string> params;
-        if (!check(TokenType::Symbol, ")"))
+    // Close the innermost group or call once its last operand is reduced.
+    // Returns true if another operand has to follow.
+    bool close_frame()
+    {
+        ExprFrame frame = this->expr_frames.back();
+        if (frame.kind == ExprFrame::Group)
+        {
+            consume(TokenType::RightParen, "Expected ')'");
+            this->expr_frames.pop_back();
+            return false;
+        }
+
+        this->expr_scratch.push_back(this->operands.back());
+        this->operands.pop_back();
+
+        // Another argument follows, parse it inside the same frame
+        if (match(TokenType::Comma))
+        {
+            return true;
+        }
+
+        consume(TokenType::RightParen, "Expected ')' after function arguments");
+        auto args = pop_scratch(expr_scratch, frame.argument_base);
+        this->operands.push_back(track(arena.make<CallExpr>(frame.name, frame.symbol, args, loc(previous()), frame.tail)));
+        this->expr_frames.pop_back();
+        return false;
+    }
+
+    Stmt *parse_function()
+    {
+        std::string_view name = text(consume(TokenType::Identifier, "Expected function name"));
+        SymbolId symbol = intern(name);
+        consume(TokenType::LeftParen, "Expected '(' after function name");
+
+        std::vector<std::string_view> params;
+        if (!check(TokenType::RightParen))
         {
             do
             {
-                params.push_back(consume(TokenType::Identifier, "Expected parameter name").value);
-            } while (match(TokenType::Symbol, ","));
+                params.emplace_back(text(consume(TokenType::Identifier, "Expected parameter name")));
+            } while (match(TokenType::Comma));
+        }
+        consume(TokenType::RightParen, "Expected ')' after parameters");
+
+        std::vector<SymbolId> param_symbols;
+        for (std::string_view param : params)
+        {
+            param_symbols.push_back(intern(param));
         }
-        consume(TokenType::Symbol, ")", "Expected ')' after parameters");
 
         auto body = parse_block();
-        return std::make_unique<FunctionStmt>(name, std::move(params), std::move(body));
+        auto fn = arena.make<FunctionStmt>(name, symbol, arena.copy_array(params), arena.copy_array(param_symbols), body);
+        for (SymbolId &symbol : fn->param_symbols)
+        {
+            track(symbol);
+        }
+        return track(fn);
     }
 
-    std::unique_ptr<Stmt> parse_let()
+    Stmt *parse_let()
     {
-        auto name = consume(TokenType::Identifier, "Expected variable name").value;
-        consume(TokenType::Symbol, "=", "Expected '=' after variable name");
+        std::string_view name = text(consume(TokenType::Identifier, "Expected variable name"));
+        SymbolId symbol = intern(name);
+        consume(TokenType::Equal, "Expected '=' after variable name");
         auto init = parse_expression();
-        consume(TokenType::Symbol, ";", "Expected ';' after variable declaration");
-        return std::make_unique<LetStmt>(name, std::move(init));
+        consume(TokenType::Semicolon, "Expected ';' after variable declaration");
+        return track(arena.make<LetStmt>(name, symbol, init));
     }
 
-    std::unique_ptr<Stmt> parse_declaration()
+    Stmt *parse_declaration()
     {
-        if (match(TokenType::Keyword, "let"))
+        if (match(TokenType::Let))
             return this->parse_let();
-        if (match(TokenType::Keyword, "fn"))
+        if (match(TokenType::Fn))
             return this->parse_function();
         return this->parse_statement();
     }
 
-    std::unique_ptr<Stmt> parse_statement()
+    Stmt *parse_statement()
     {
-        if (match(TokenType::Keyword, "return"))
+        if (match(TokenType::Return))
         {
-            std::unique_ptr<Expr> value = nullptr;
-            if (!check(TokenType::Symbol, ";"))
+            Expr *value = nullptr;
+            if (!check(TokenType::Semicolon))
             {
                 value = parse_expression();
             }
-            consume(TokenType::Symbol, ";", "Expected ';' after return statement");
-            return std::make_unique<ReturnStmt>(std::move(value));
+            consume(TokenType::Semicolon, "Expected ';' after return statement");
+            return arena.make<ReturnStmt>(value);
+        }
+        if (match(TokenType::If))
+            return parse_if();
+        if (match(TokenType::While))
+        {
+            Expr *condition = parse_expression();
+            return arena.make<WhileStmt>(condition, parse_block());
         }
+        if (check(TokenType::LeftBrace))
+            return parse_block();
         return parse_expression_statement();
     }
 
-    std::unique_ptr<Stmt> parse_expression_statement()
+    // The condition needs no parentheses, a parenthesized one is just a group
+    Stmt *parse_if()
+    {
+        Expr *condition = parse_expression();
+        BlockStmt *then_branch = parse_block();
+        Stmt *else_branch = nullptr;
+        if (match(TokenType::Else))
+        {
+            else_branch = match(TokenType::If) ? parse_if() : parse_block();
+        }
+        return arena.make<IfStmt>(condition, then_branch, else_branch);
+    }
+
+    Stmt *parse_expression_statement()
     {
         auto expr = parse_expression();
-        consume(TokenType::Symbol, ";", "Expected ';' after expression");
-        return std::make_unique<ExprStmt>(std::move(expr));
+        consume(TokenType::Semicolon, "Expected ';' after expression");
+        return arena.make<ExprStmt>(expr);
     }
 
-    std::unique_ptr<BlockStmt> parse_block()
+    BlockStmt *parse_block()
     {
-        consume(TokenType::Symbol, "{", "Expected '{' to start block");
-        std::vector<std::unique_ptr<Stmt>> statements;
+        consume(TokenType::LeftBrace, "Expected '{' to start block");
+        std::size_t base = stmt_scratch.size();
 
-        while (!check(TokenType::Symbol, "}") && !is_at_end())
+        while (!check(TokenType::RightBrace) && !is_at_end())
         {
-            statements.push_back(parse_declaration());
+            stmt_scratch.push_back(parse_declaration());
         }
 
-        consume(TokenType::Symbol, "}", "Expected '}' after block");
-        return std::make_unique<BlockStmt>(std::move(statements));
+        consume(TokenType::RightBrace, "Expected '}' after block");
+        return arena.make<BlockStmt>(pop_scratch(stmt_scratch, base));
     }
 
     [[noreturn]] void error(const std::string &message) const
     {
+        if (this->speculative)
+        {
+            throw ParseFailed{};
+        }
+
         if (is_at_end())
         {
             std::cerr << "[PARSER] Unexpected end of input: " << message << "\n";
@@ -248,17 +478,18 @@ private:
         else
         {
             const auto &tok = peek();
-            std::cerr << "[PARSER] " << this->file_name << ":" << tok.line << ":" << tok.column
+            PresumedLocation loc = this->sources.resolve(this->loc(tok));
+            std::cerr << "[PARSER] " << loc.file_name << ":" << loc.line << ":" << loc.column
                       << ": " << message
-                      << " near token '" << tok.value << "'\n";
+                      << " near token '" << this->text(tok) << "'\n";
         }
         std::exit(69);
     }
 
 public:
-    std::vector<std::unique_ptr<Stmt>> parse_program()
+    std::vector<Stmt *> parse_program()
     {
-        std::vector<std::unique_ptr<Stmt>> statements;
+        std::vector<Stmt *> statements;
 
         while (!is_at_end())
         {
@@ -1,363 +1,262 @@
 #pragma once
-#include <fstream>
-#include <sstream>
-#include "parser.hpp"
-#include <unordered_map>
-#include <iomanip>
-#include <cstring>
+#include <bit>
+#include <ostream>
+#include <vector>
+#include "ir.hpp"
 
+// Prints an IR module as QBE IL
 class QBECodegen
 {
     std::ostream &out;
-    int temp_count = 0;
-    int label_count = 0;
-    std::unordered_map<std::string, std::string> locals;
-    std::unordered_map<std::string, std::string> globals;
+    const StringInterner &symbols;
 
-public:
-    QBECodegen(std::ostream &out) : out(out) {}
-
-    std::string gen_temp()
-    {
-        return "%" + std::to_string(temp_count++);
-    }
-
-    std::string gen_label(const std::string &base = "L")
-    {
-        return base + std::to_string(label_count++);
-    }
+    // Temporaries are numbered densely in the order they are defined, passes
+    // leave gaps in the value ids
+    std::vector<std::uint32_t> numbers;
 
-    // Convert a double (64-bit) to IEEE-754 hex string (e.g., 0x4034800000000000)
-    std::string double_to_hex(double value)
+    // Prints an operand the way QBE spells it, e.g. out << operand(fn, value)
+    struct Operand
     {
-        uint64_t bits;
-        std::memcpy(&bits, &value, sizeof(bits));
-
-        std::stringstream ss;
-        ss << "0x" << std::hex << std::setfill('0') << std::setw(16) << bits;
-        return ss.str();
-    }
+        const IRFunction &fn;
+        IROperand value;
+        const StringInterner &symbols;
+        const std::vector<std::uint32_t> &numbers;
 
-    void emit_return(const ReturnStmt *ret)
-    {
-        // std::string val = emit_expr(ret->value.get());
-        // out << "\tret " << val << "\n";
-        out << "\tret 0" << "\n";
-    }
+        friend std::ostream &operator<<(std::ostream &os, const Operand &op)
+        {
+            switch (op.value.kind)
+            {
+            case IROperand::None:
+                break;
+            case IROperand::Value:
+                // Parameters keep their names
+                if (op.value.id < op.fn.params.size())
+                    os << '%' << op.symbols.get_name(op.fn.params[op.value.id]);
+                else
+                    os << '%' << op.numbers[op.value.id];
+                break;
+            case IROperand::Int:
+                os << static_cast<long>(op.value.bits);
+                break;
+            case IROperand::Float:
+                os << float_literal(std::bit_cast<double>(op.value.bits));
+                break;
+            case IROperand::Global:
+                os << '$' << op.symbols.get_name(op.value.id);
+                break;
+            case IROperand::Ready:
+                os << "$.ready." << op.symbols.get_name(op.value.id);
+                break;
+            case IROperand::String:
+                os << "$.str." << op.value.id;
+                break;
+            }
+            return os;
+        }
+    };
 
-    void emit_expr_stmt(const ExprStmt *expr_stmt)
+    Operand operand(const IRFunction &fn, IROperand value) const
     {
-        emit_expr(expr_stmt->expr.get());
+        return {fn, value, this->symbols, this->numbers};
     }
 
-    // Emit
-    void emit_global_let(const LetStmt *let)
+    static const char *mnemonic(Opcode op)
     {
-        std::string label = "$" + let->name;
-        globals[let->name] = label;
-
-        const Expr *init = let->value.get();
-
-        out << "data " << label << " = { ";
-
-        if (auto intlit = dynamic_cast<const IntExpr *>(init))
-        {
-            out << "l " << intlit->value;
-        }
-        else if (auto floatlit = dynamic_cast<const FloatExpr *>(init))
-        {
-            out << "d " << floatlit->value;
-            // out << "d " << double_to_hex(floatlit->value);
-        }
-        else if (auto strlit = dynamic_cast<const StringExpr *>(init))
+        switch (op)
         {
-            std::string str_label = "$.str." + let->name;
-            out << "l " << str_label << " }\n";
-            out << "data " << str_label << " = { b \"" << strlit->value << "\\00\" }";
-            return;
+        case Opcode::Copy:
+            return "copy";
+        case Opcode::Add:
+            return "add";
+        case Opcode::Sub:
+            return "sub";
+        case Opcode::Mul:
+            return "mul";
+        case Opcode::Div:
+            return "div";
+        case Opcode::Shl:
+            return "shl";
+        case Opcode::Sar:
+            return "sar";
+        case Opcode::Shr:
+            return "shr";
+        case Opcode::And:
+            return "and";
+        case Opcode::IntToFloat:
+            return "sltof";
+        case Opcode::FloatToInt:
+            return "dtosi";
+        case Opcode::Load:
+            return "load";
+        case Opcode::Store:
+            return "store";
+        case Opcode::Ne:
+            return "cne";
+        case Opcode::Phi:
+            return "phi";
+        case Opcode::Get:
+        case Opcode::Call:
+            return "call";
         }
-        else
-        {
-            error(init, "Unsupported global initializer.");
-        }
-
-        out << " }\n";
+        return "?";
     }
 
-    void emit_start()
+    static std::string label(BlockId block)
     {
-        out << "\n@start = data l 0\n"; // QBE requires data for @start, but it's also the entry
-
-        out << "\n$start = function l () {\n";
-        out << "entry0:\n";
-        out << "\t%0 = call $main()\n";
-        out << "\tret %0\n";
-        out << "}\n";
+        return block == 0 ? "@start" : "@b" + std::to_string(block);
     }
 
-    // Emit a function
-    void emit_function(const FunctionStmt *fn)
+    void emit_instruction(const IRFunction &fn, const IRBlock &code, const IRInstruction &inst)
     {
-        std::string name = (fn->name == "main") ? "_jank_user_main" : fn->name;
-        out << "\n$" << name << " = function l ("; // TODO: adjust return/param types
-        for (size_t i = 0; i < fn->params.size(); i++)
+        out << "\t";
+        if (inst.result != IRInstruction::none)
         {
-            if (i > 0)
-            {
-                out << ", ";
-            }
-            out << "l %" << fn->params[i];
+            out << operand(fn, IROperand::value(inst.result)) << " =" << qbe_class(inst.type) << " ";
         }
-        out << ") {\n";
-
-        out << gen_label("entry") << ":\n";
 
-        locals.clear();
-        for (size_t i = 0; i < fn->params.size(); ++i)
+        switch (inst.op)
         {
-            locals[fn->params[i]] = "%" + fn->params[i];
-        }
-
-        for (const auto &stmt : fn->body->statements)
-        {
-            emit_stmt(stmt.get());
-        }
-
-        out << "\tret 0\n"; // Make sure to ret something, adjust as needed
-        out << "}\n";
-    }
-
-    void emit_stmt(const Stmt *stmt)
-    {
-        if (auto let = dynamic_cast<const LetStmt *>(stmt))
-        {
-            std::string value_reg = emit_expr(let->value.get());
-
-            // Local or global
-            if (globals.count(let->name))
+        case Opcode::Load:
+        case Opcode::Store:
+            out << mnemonic(inst.op) << qbe_class(inst.type) << " " << operand(fn, inst.a);
+            if (inst.b.kind != IROperand::None)
+                out << ", " << operand(fn, inst.b);
+            break;
+        case Opcode::Get:
+            out << "call $.get." << symbols.get_name(inst.a.id) << "()";
+            break;
+        case Opcode::Call:
+            out << "call $" << inst.name << "(";
+            for (std::uint32_t i = 0; i < inst.arg_count; i++)
             {
-                out << "\tstore " << value_reg << ", " << globals[let->name] << "\n";
+                if (i > 0)
+                    out << ", ";
+                if (i == inst.variadic)
+                    out << "..., ";
+                IROperand arg = fn.arguments[inst.first_arg + i];
+                out << qbe_class(fn.type_of(arg)) << " " << operand(fn, arg);
             }
-            else
+            out << ")";
+            break;
+        case Opcode::Ne:
+            // Compares in the class of the operands
+            out << mnemonic(inst.op) << qbe_class(fn.type_of(inst.a)) << " " << operand(fn, inst.a) << ", "
+                << operand(fn, inst.b);
+            break;
+        case Opcode::Phi:
+            out << mnemonic(inst.op);
+            for (std::uint32_t i = 0; i < inst.arg_count; i++)
             {
-                std::string reg = gen_temp();
-                locals[let->name] = reg;
-                out << "\t" << reg << " = copy " << value_reg << "\n";
+                out << (i > 0 ? ", " : " ") << label(code.predecessors[i]) << " "
+                    << operand(fn, fn.arguments[inst.first_arg + i]);
             }
+            break;
+        default:
+            out << mnemonic(inst.op) << " " << operand(fn, inst.a);
+            if (inst.b.kind != IROperand::None)
+                out << ", " << operand(fn, inst.b);
+            break;
         }
-        else if (auto exprstmt = dynamic_cast<const ExprStmt *>(stmt))
-        {
-            emit_expr_stmt(exprstmt);
-        }
-        else if (auto ret = dynamic_cast<const ReturnStmt *>(stmt))
-        {
-            emit_return(ret);
-        }
-        else
-        {
-            throw std::runtime_error("Unknown statement in codegen");
-        }
+        out << "\n";
     }
 
-    std::string emit_expr(const Expr *expr)
+public:
+    QBECodegen(std::ostream &out, const StringInterner &symbols)
+        : out(out), symbols(symbols) {}
+
+    void emit_function(const IRFunction &fn)
     {
-        if (auto intlit = dynamic_cast<const IntExpr *>(expr))
+        out << (fn.exported ? "export " : "") << "function ";
+        if (fn.result != Type::Void)
         {
-            std::string reg = gen_temp();
-            out << "\t" << reg << " = l const " << intlit->value << "\n";
-            return reg;
+            out << qbe_class(fn.result) << " ";
         }
-
-        if (auto floatlit = dynamic_cast<const FloatExpr *>(expr))
+        out << "$" << fn.name << "(";
+        for (std::size_t i = 0; i < fn.params.size(); i++)
         {
-            std::string reg = gen_temp();
-            out << "\t" << reg << " = d const " << floatlit->value << "\n";
-            return reg;
-        }
-
-        if (auto stringlit = dynamic_cast<const StringExpr *>(expr))
-        {
-            std::string reg = gen_temp();
-            // Assuming you have a way to handle string constants in QBE
-            out << "\t" << reg << " = s const \"" << stringlit->value << "\"\n";
-            return reg;
+            if (i > 0)
+                out << ", ";
+            out << qbe_class(fn.value_types[i]) << " " << operand(fn, IROperand::value(static_cast<ValueId>(i)));
         }
+        out << ") {\n";
 
-        if (auto ident = dynamic_cast<const IdentifierExpr *>(expr))
+        this->numbers.assign(fn.value_types.size(), 0);
+        std::uint32_t next = 0;
+        for (const IRBlock &code : fn.blocks)
         {
-            if (locals.count(ident->name))
+            for (const IRInstruction &phi : code.phis)
             {
-                return locals[ident->name];
+                this->numbers[phi.result] = next++;
             }
-            else if (globals.count(ident->name))
+            for (const IRInstruction &inst : code.instructions)
             {
-                std::string reg = gen_temp();
-                out << "\t" << reg << " = l load " << globals[ident->name] << "\n";
-                return reg;
+                if (inst.result != IRInstruction::none)
+                    this->numbers[inst.result] = next++;
             }
-            throw std::runtime_error("Undefined variable: " + ident->name);
         }
 
-        if (auto bin = dynamic_cast<const BinaryExpr *>(expr))
+        for (BlockId block = 0; block < fn.blocks.size(); block++)
         {
-            std::string lhs = emit_expr(bin->lhs.get());
-            std::string rhs = emit_expr(bin->rhs.get());
-            std::string result = gen_temp();
-
-            if (bin->op == "+")
-                out << "\t" << result << " = l add " << lhs << ", " << rhs << "\n";
-            else if (bin->op == "-")
-                out << "\t" << result << " =l sub " << lhs << ", " << rhs << "\n";
-            else if (bin->op == "*")
-                out << "\t" << result << " =l mul " << lhs << ", " << rhs << "\n";
-            else if (bin->op == "/")
-                out << "\t" << result << " =l divs " << lhs << ", " << rhs << "\n";
-            else
-                throw std::runtime_error("Unsupported binary operator: " + bin->op);
-
-            return result;
-        }
-
-        if (auto call = dynamic_cast<const CallExpr *>(expr))
-        {
-            if (call->name == "println")
+            out << label(block) << "\n";
+            const IRBlock &code = fn.blocks[block];
+            for (const IRInstruction &phi : code.phis)
             {
-                std::string format_str;
-                std::vector<std::string> arg_regs;
-
-                for (size_t i = 0; i < call->arguments.size(); ++i)
-                {
-                    const Expr *arg = call->arguments[i].get();
-
-                    // Determine format specifier based on expression type
-                    if (dynamic_cast<const IntExpr *>(arg))
-                        format_str += "%d";
-                    else if (dynamic_cast<const FloatExpr *>(arg))
-                        format_str += "%f";
-                    else if (dynamic_cast<const StringExpr *>(arg))
-                        format_str += "%s";
-                    else if (dynamic_cast<const IdentifierExpr *>(arg))
-                    {
-                        // You might need symbol table/type info to decide format here.
-                        // For now, assume integer:
-                        format_str += "%d";
-                    }
-                    else
-                    {
-                        format_str += "%s"; // fallback as string
-                    }
-
-                    if (i < call->arguments.size() - 1)
-                        format_str += " "; // space between arguments
-                }
-                format_str += "\\n"; // newline at the end
-
-                // Emit the format string as a global constant
-                std::string fmt_reg = gen_temp();
-                out << "\t" << fmt_reg << " =s const \"" << format_str << "\"\n";
-
-                // Emit argument registers
-                for (const auto &arg : call->arguments)
-                {
-                    arg_regs.push_back(emit_expr(arg.get()));
-                }
-
-                // Call printf: assume signature like int printf(const char*, ...)
-                out << "\tcall $printf(s " << fmt_reg;
-                for (const auto &reg : arg_regs)
-                {
-                    out << ", l " << reg; // use 'l' for integer arguments, adjust if float/string
-                }
-                out << ")\n";
-
-                return ""; // println returns void
+                emit_instruction(fn, code, phi);
             }
-
-            // Normal function call
-            std::vector<std::string> arg_regs;
-            for (const auto &arg : call->arguments)
+            for (const IRInstruction &inst : code.instructions)
             {
-                arg_regs.push_back(emit_expr(arg.get()));
+                emit_instruction(fn, code, inst);
             }
 
-            std::string result = gen_temp();
-
-            out << "\t" << result << " = call $" << call->name << "(";
-            for (size_t i = 0; i < arg_regs.size(); ++i)
+            switch (code.exit)
             {
-                if (i > 0)
-                    out << ", ";
-                out << "l " << arg_regs[i];
+            case IRBlock::Exit::Return:
+                out << "\tret";
+                if (code.value.kind != IROperand::None)
+                    out << " " << operand(fn, code.value);
+                out << "\n";
+                break;
+            case IRBlock::Exit::Jump:
+                out << "\tjmp " << label(code.target) << "\n";
+                break;
+            case IRBlock::Exit::Branch:
+                out << "\tjnz " << operand(fn, code.value) << ", " << label(code.target) << ", " << label(code.otherwise) << "\n";
+                break;
             }
-            out << ")\n";
-
-            return result;
         }
-
-        error(expr, "Unknown expression in codegen");
+        out << "}\n";
     }
 
-    void emit_program(const std::vector<std::unique_ptr<Stmt>> &stmts)
+    void emit_module(const IRModule &module)
     {
-        std::vector<const LetStmt *> computed_globals;
-
-        // 1) Emit globals
-        for (const auto &stmt : stmts)
+        for (const IRData &data : module.data)
         {
-            if (auto let = dynamic_cast<const LetStmt *>(stmt.get()))
+            switch (data.section)
             {
-                const Expr *init = let->value.get();
-                if (dynamic_cast<const IntExpr *>(init) ||
-                    dynamic_cast<const FloatExpr *>(init) ||
-                    dynamic_cast<const StringExpr *>(init))
-                {
-                    emit_global_let(let);
-                }
-                else
-                {
-                    computed_globals.push_back(let);
-                    std::string label = "$" + let->name;
-                    globals[let->name] = label;
-                    out << "data " << label << " = { l 0 }\n"; // zero-init, runtime will overwrite
-                }
+            case IRData::Section::Data:
+                break;
+            case IRData::Section::ReadOnly:
+                out << "section \".rodata\" ";
+                break;
+            case IRData::Section::RelRo:
+                out << "section \".data.rel.ro\" ";
+                break;
             }
+            out << "data $" << data.name << " = { " << data.contents << " }\n";
         }
 
-        // 2) Emit functions and check for main
-        bool has_main = false;
-        for (const auto &stmt : stmts)
+        for (const IRFunction &fn : module.functions)
         {
-            if (auto fn = dynamic_cast<const FunctionStmt *>(stmt.get()))
-            {
-                if (fn->name == "main")
-                    has_main = true;
-                emit_function(fn);
-            }
+            out << "\n";
+            emit_function(fn);
         }
 
-        if (!has_main)
-            throw std::runtime_error("Mandatory function 'main' not found.");
-
-        // 3) Emit the real program entry point that calls main
-        out << "\nexport function w $main() {\n";
-        out << "@start\n";
-
-        // Emit computed globals
-        for (auto let : computed_globals)
+        // String constants used by the code
+        if (!module.strings.empty())
+            out << "\n";
+        for (std::size_t i = 0; i < module.strings.size(); i++)
         {
-            std::string reg = emit_expr(let->value.get());
-            out << "\tstore" << "l " << reg << ", $" << let->name << "\n";
+            out << "section \".rodata\" data $.str." << i << " = { b \"" << module.strings[i] << "\\00\" }\n";
         }
-
-        out << "\tcall $_jank_user_main()\n";
-        out << "\tret 0\n";
-        out << "}\n";
-    }
-
-    [[noreturn]] void error(const Expr *expr, const std::string &message) const
-    {
-        // Assuming Expr has token info (line, col), or you pass line info separately
-        std::cerr << "[CODEGEN] Line " << expr->line << ": " << message << "\n";
-        std::exit(69);
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+// Bulk character scanning used by the lexer's hot loop. Each kernel returns a
+// pointer to the first byte in [p, end) that does not belong to the run it
+// skips, or end if the whole range does.
+//
+// On x86-64 the kernels process 16 (SSE2) or 32 (AVX2) bytes per step. The
+// widest implementation the CPU supports is picked once at startup, other
+// targets use the scalar versions.
+struct ScanKernels
+{
+    // Spaces, tabs, carriage returns and newlines
+    const char *(*skip_whitespace)(const char *p, const char *end);
+
+    // [A-Za-z0-9_]
+    const char *(*skip_identifier)(const char *p, const char *end);
+
+    // [0-9]
+    const char *(*skip_digits)(const char *p, const char *end);
+
+    // Name of the selected implementation, for diagnostics
+    const char *name;
+};
+
+const ScanKernels &get_scan_kernels();
+
+// Find the next occurrence of c, or end. Used for string literals and
+// comments, libc's memchr is already vectorized so there is no kernel for it.
+const char *find_char(const char *p, const char *end, char c);
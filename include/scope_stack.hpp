@@ -0,0 +1,84 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+#include "interner.hpp"
+
+// Nested scopes over symbol ids. The innermost binding of every symbol sits in
+// one flat vector indexed by id, so a lookup is a single load. Binding a name
+// saves what it shadowed, and leaving a scope restores those in reverse.
+template <typename T>
+class ScopeStack
+{
+    std::vector<T> bindings;
+
+    // Depth of the scope each innermost binding was made in
+    std::vector<std::uint32_t> depths;
+
+    std::vector<std::tuple<SymbolId, T, std::uint32_t>> shadowed;
+    std::vector<std::size_t> scopes;
+
+public:
+    // Ids have to be below symbol_count, unbound symbols read as `unbound`
+    explicit ScopeStack(std::size_t symbol_count, T unbound = T{})
+        : bindings(symbol_count, unbound), depths(symbol_count) {}
+
+    void push_scope()
+    {
+        this->scopes.push_back(this->shadowed.size());
+    }
+
+    void pop_scope()
+    {
+        std::size_t base = this->scopes.back();
+        this->scopes.pop_back();
+        while (this->shadowed.size() > base)
+        {
+            auto &[symbol, previous, depth] = this->shadowed.back();
+            this->bindings[symbol] = previous;
+            this->depths[symbol] = depth;
+            this->shadowed.pop_back();
+        }
+    }
+
+    void bind(SymbolId symbol, T value)
+    {
+        this->shadowed.emplace_back(symbol, this->bindings[symbol], this->depths[symbol]);
+        this->bindings[symbol] = value;
+        this->depths[symbol] = static_cast<std::uint32_t>(this->scopes.size());
+    }
+
+    // Change the innermost binding of symbol where it was made
+    void assign(SymbolId symbol, T value)
+    {
+        this->bindings[symbol] = value;
+    }
+
+    const T &lookup(SymbolId symbol) const
+    {
+        return this->bindings[symbol];
+    }
+
+    // Number of scopes entered and not left yet
+    std::size_t depth() const
+    {
+        return this->scopes.size();
+    }
+
+    // Depth of the scope the innermost binding of symbol was made in, 0 for
+    // unbound symbols
+    std::size_t depth_of(SymbolId symbol) const
+    {
+        return this->depths[symbol];
+    }
+
+    // Whether the innermost binding of symbol was made in a scope enclosing
+    // the current one, at least `floor` deep. A let of such a local assigns
+    // it, a let in the scope that declared it declares a new one.
+    bool is_outer(SymbolId symbol, std::size_t floor) const
+    {
+        std::uint32_t depth = this->depths[symbol];
+        return depth >= floor && depth < this->scopes.size();
+    }
+};
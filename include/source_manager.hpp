@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Index of a file loaded into the SourceManager
+using FileId = std::uint32_t;
+
+// A position in any loaded file, encoded as a single offset into the
+// concatenation of all files. Each file gets its own disjoint range, so the
+// owning file can be recovered from the offset alone.
+using SourceLocation = std::uint32_t;
+
+// A location resolved to something a human can read. Only built when a
+// diagnostic is actually printed.
+struct PresumedLocation
+{
+    std::string_view file_name;
+    int line;
+    int column;
+};
+
+class SourceManager
+{
+    struct SourceFile
+    {
+        std::string name;
+        std::string_view contents;
+        SourceLocation base = 0;
+
+        // Backing storage, either a read-only mapping or an owned copy
+        void *mapping = nullptr;
+        std::size_t mapping_size = 0;
+        std::string owned;
+
+        // Offsets at which each line begins, built on first use
+        mutable std::vector<std::uint32_t> line_starts;
+    };
+
+    std::vector<std::unique_ptr<SourceFile>> files;
+    SourceLocation next_base = 0;
+
+    FileId add_file(std::unique_ptr<SourceFile> file);
+
+    const std::vector<std::uint32_t> &get_line_starts(const SourceFile &file) const;
+
+public:
+    SourceManager() = default;
+    SourceManager(const SourceManager &) = delete;
+    SourceManager &operator=(const SourceManager &) = delete;
+    ~SourceManager();
+
+    // Map a file from disk read-only. Exits on failure.
+    FileId load_file(const std::string &path);
+
+    // Register an in-memory buffer under the given name
+    FileId add_buffer(const std::string &name, std::string contents);
+
+    // Register text owned elsewhere, e.g. inside a mapped AST file. It has to
+    // outlive the manager.
+    FileId add_view(const std::string &name, std::string_view contents);
+
+    std::string_view get_contents(FileId file) const
+    {
+        return this->files[file]->contents;
+    }
+
+    const std::string &get_name(FileId file) const
+    {
+        return this->files[file]->name;
+    }
+
+    // Global location of the first byte of a file
+    SourceLocation get_base(FileId file) const
+    {
+        return this->files[file]->base;
+    }
+
+    FileId get_file(SourceLocation loc) const;
+
+    // Turn a global location into file, line and column by binary searching
+    // the file's line table
+    PresumedLocation resolve(SourceLocation loc) const;
+};
@@ -1,48 +1,185 @@
 #pragma once
-#include <string>
-#include <memory>
+#include <span>
+#include <string_view>
 #include <vector>
 #include "expr.hpp"
 
+enum class StmtKind : std::uint8_t
+{
+    Let,
+    Expr,
+    Return,
+    Block,
+    Function,
+    If,
+    While,
+};
+
+// Like expressions, statements are arena allocated, never destroyed
+// individually and dispatched on their kind tag
 struct Stmt
 {
-    virtual ~Stmt() = default;
+    StmtKind kind;
+
+protected:
+    explicit Stmt(StmtKind kind) : kind(kind) {}
 };
 
 struct LetStmt : Stmt
 {
-    std::string name;
-    std::unique_ptr<Expr> value;
-    LetStmt(std::string name, std::unique_ptr<Expr> value)
-        : name(std::move(name)), value(std::move(value)) {}
+    static constexpr StmtKind Kind = StmtKind::Let;
+
+    std::string_view name;
+    SymbolId symbol;
+    Expr *value;
+    LetStmt(std::string_view name, SymbolId symbol, Expr *value)
+        : Stmt(Kind), name(name), symbol(symbol), value(value) {}
 };
 
 struct ExprStmt : Stmt
 {
-    std::unique_ptr<Expr> expr;
+    static constexpr StmtKind Kind = StmtKind::Expr;
+
+    Expr *expr;
 
-    ExprStmt(std::unique_ptr<Expr> expr) : expr(std::move(expr)) {}
+    ExprStmt(Expr *expr) : Stmt(Kind), expr(expr) {}
 };
 
 struct ReturnStmt : Stmt
 {
-    std::unique_ptr<Expr> value;
-    ReturnStmt(std::unique_ptr<Expr> value) : value(std::move(value)) {}
+    static constexpr StmtKind Kind = StmtKind::Return;
+
+    Expr *value;
+    ReturnStmt(Expr *value) : Stmt(Kind), value(value) {}
 };
 
 struct BlockStmt : Stmt
 {
-    std::vector<std::unique_ptr<Stmt>> statements;
+    static constexpr StmtKind Kind = StmtKind::Block;
 
-    BlockStmt(std::vector<std::unique_ptr<Stmt>> statements)
-        : statements(std::move(statements)) {}
+    std::span<Stmt *> statements;
+
+    BlockStmt(std::span<Stmt *> statements)
+        : Stmt(Kind), statements(statements) {}
 };
 
 struct FunctionStmt : Stmt
 {
-    std::string name;
-    std::vector<std::string> params;
-    std::unique_ptr<BlockStmt> body;
-    FunctionStmt(std::string name, std::vector<std::string> params, std::unique_ptr<BlockStmt> body)
-        : name(std::move(name)), params(std::move(params)), body(std::move(body)) {}
-};
\ No newline at end of file
+    static constexpr StmtKind Kind = StmtKind::Function;
+
+    std::string_view name;
+    SymbolId symbol;
+    std::span<std::string_view> params;
+    std::span<SymbolId> param_symbols;
+    BlockStmt *body;
+    FunctionStmt(std::string_view name, SymbolId symbol, std::span<std::string_view> params,
+                 std::span<SymbolId> param_symbols, BlockStmt *body)
+        : Stmt(Kind), name(name), symbol(symbol), params(params), param_symbols(param_symbols), body(body) {}
+};
+
+// Runs then_branch if condition isn't zero, otherwise else_branch: a block,
+// another IfStmt for `else if`, or nullptr
+struct IfStmt : Stmt
+{
+    static constexpr StmtKind Kind = StmtKind::If;
+
+    Expr *condition;
+    BlockStmt *then_branch;
+    Stmt *else_branch;
+    IfStmt(Expr *condition, BlockStmt *then_branch, Stmt *else_branch)
+        : Stmt(Kind), condition(condition), then_branch(then_branch), else_branch(else_branch) {}
+};
+
+// Runs body for as long as condition isn't zero
+struct WhileStmt : Stmt
+{
+    static constexpr StmtKind Kind = StmtKind::While;
+
+    Expr *condition;
+    BlockStmt *body;
+    WhileStmt(Expr *condition, BlockStmt *body)
+        : Stmt(Kind), condition(condition), body(body) {}
+};
+
+static_assert(std::is_trivially_destructible_v<FunctionStmt> && std::is_trivially_destructible_v<IfStmt>,
+              "AST nodes are never destroyed individually");
+
+// Call visitor with stmt downcast to its concrete type. Every kind has to be
+// handled, a visitor missing an overload fails to compile.
+template <typename Visitor>
+decltype(auto) visit(const Stmt *stmt, Visitor &&visitor)
+{
+    switch (stmt->kind)
+    {
+    case StmtKind::Let:
+        return visitor(static_cast<const LetStmt *>(stmt));
+    case StmtKind::Expr:
+        return visitor(static_cast<const ExprStmt *>(stmt));
+    case StmtKind::Return:
+        return visitor(static_cast<const ReturnStmt *>(stmt));
+    case StmtKind::Block:
+        return visitor(static_cast<const BlockStmt *>(stmt));
+    case StmtKind::Function:
+        return visitor(static_cast<const FunctionStmt *>(stmt));
+    case StmtKind::If:
+        return visitor(static_cast<const IfStmt *>(stmt));
+    case StmtKind::While:
+        return visitor(static_cast<const WhileStmt *>(stmt));
+    }
+    __builtin_unreachable();
+}
+
+// The expression a statement evaluates first: a let's value, a return's
+// value, a condition. nullptr for blocks, functions and a bare return.
+inline const Expr *statement_expr(const Stmt *stmt)
+{
+    switch (stmt->kind)
+    {
+    case StmtKind::Let:
+        return static_cast<const LetStmt *>(stmt)->value;
+    case StmtKind::Expr:
+        return static_cast<const ExprStmt *>(stmt)->expr;
+    case StmtKind::Return:
+        return static_cast<const ReturnStmt *>(stmt)->value;
+    case StmtKind::If:
+        return static_cast<const IfStmt *>(stmt)->condition;
+    case StmtKind::While:
+        return static_cast<const WhileStmt *>(stmt)->condition;
+    case StmtKind::Block:
+    case StmtKind::Function:
+        break;
+    }
+    return nullptr;
+}
+
+// Call f on every statement of statements and of the blocks nested in them,
+// in source order, from an explicit stack. Nested functions aren't entered.
+template <typename F>
+void for_each_statement(std::span<Stmt *const> statements, F &&f)
+{
+    std::vector<std::span<Stmt *const>> pending{statements};
+    while (!pending.empty())
+    {
+        std::span<Stmt *const> &rest = pending.back();
+        if (rest.empty())
+        {
+            pending.pop_back();
+            continue;
+        }
+        const Stmt *stmt = rest.front();
+        rest = rest.subspan(1);
+        f(stmt);
+
+        // Pushed last to first, so they come off in order
+        if (auto ifs = as<IfStmt>(stmt))
+        {
+            if (ifs->else_branch)
+                pending.push_back(std::span<Stmt *const>(&ifs->else_branch, 1));
+            pending.push_back(ifs->then_branch->statements);
+        }
+        else if (auto loop = as<WhileStmt>(stmt))
+            pending.push_back(loop->body->statements);
+        else if (auto block = as<BlockStmt>(stmt))
+            pending.push_back(block->statements);
+    }
+}
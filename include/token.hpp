@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+
+// One kind per keyword and symbol, so the parser only ever compares integers
+enum class TokenType : std::uint8_t
+{
+    // Literals and names
+    Integer,
+    Float,
+    Identifier,
+    String,
+
+    // Keywords
+    Let,
+    Print,
+    If,
+    Else,
+    While,
+    Fn,
+    Return,
+
+    // Symbols
+    Equal,
+    Plus,
+    Minus,
+    Star,
+    Slash,
+    LeftParen,
+    RightParen,
+    LeftBrace,
+    RightBrace,
+    Semicolon,
+    Comma,
+    At,
+};
+
+constexpr bool is_number(TokenType type)
+{
+    return type == TokenType::Integer || type == TokenType::Float;
+}
+
+constexpr bool is_keyword(TokenType type)
+{
+    return type >= TokenType::Let && type <= TokenType::Return;
+}
+
+constexpr bool is_symbol(TokenType type)
+{
+    return type >= TokenType::Equal && type <= TokenType::At;
+}
+
+// Tokens don't own their text, they point back into the source buffer the
+// lexer was constructed with. That buffer has to outlive the tokens.
+// Offsets are relative to the start of the token's own file.
+struct Token
+{
+    TokenType type;
+    std::uint32_t offset; // Byte offset of the first character in the source
+    std::uint32_t length; // String literals exclude the surrounding quotes
+};
+
+static_assert(sizeof(Token) <= 12, "Token should stay compact");
+
+// Value of a numeric literal, parsed once by the lexer. Integer tokens use
+// integer and Float tokens use floating. Payloads are stored apart from the
+// tokens, in the same order as the numeric tokens they belong to.
+union LiteralValue
+{
+    std::int64_t integer;
+    double floating;
+};
@@ -0,0 +1,151 @@
+#pragma once
+#include <array>
+#include "lexer.hpp"
+
+// Pulls tokens from the lexer on demand. Only a handful of tokens around the
+// parser's position are alive at any time, so lexing and parsing share a small
+// working set and the full token list is never materialized.
+//
+// A stream can also replay tokens that were lexed up front, e.g. by
+// Lexer::tokenize_parallel.
+class TokenStream
+{
+    struct Entry
+    {
+        Token token;
+        LiteralValue literal;
+    };
+
+    // Must be a power of two. Holds the previous token, the current one and
+    // room for a little extra lookahead.
+    static constexpr std::size_t capacity = 4;
+
+    // Exactly one of these is set
+    Lexer *lexer = nullptr;
+    const std::vector<Token> *tokens = nullptr;
+    const std::vector<LiteralValue> *literals = nullptr;
+
+    // Next unread entries of tokens and literals in replay mode, and the end
+    // of the replayed range
+    std::size_t token_pos = 0;
+    std::size_t literal_pos = 0;
+    std::size_t token_end = 0;
+
+    std::array<Entry, capacity> ring{};
+
+    // Number of tokens consumed so far, the current token is at index `head`
+    std::size_t head = 0;
+
+    // Number of tokens pulled from the lexer so far
+    std::size_t tail = 0;
+
+    bool exhausted = false;
+
+    const Entry &at(std::size_t index) const
+    {
+        return this->ring[index & (capacity - 1)];
+    }
+
+    // Make sure `count` tokens past the current one are buffered, if the input
+    // has that many left
+    void fill(std::size_t count)
+    {
+        while (!this->exhausted && this->tail < this->head + count)
+        {
+            Entry &entry = this->ring[this->tail & (capacity - 1)];
+            if (!this->next(entry))
+            {
+                this->exhausted = true;
+                break;
+            }
+            ++this->tail;
+        }
+    }
+
+    bool next(Entry &entry)
+    {
+        if (this->lexer)
+        {
+            if (!this->lexer->next(entry.token))
+            {
+                return false;
+            }
+            if (is_number(entry.token.type))
+            {
+                entry.literal = this->lexer->get_literal();
+            }
+            return true;
+        }
+
+        if (this->token_pos >= this->token_end)
+        {
+            return false;
+        }
+        entry.token = (*this->tokens)[this->token_pos++];
+        if (is_number(entry.token.type))
+        {
+            entry.literal = (*this->literals)[this->literal_pos++];
+        }
+        return true;
+    }
+
+public:
+    explicit TokenStream(Lexer &lexer) : lexer(&lexer)
+    {
+        this->fill(1);
+    }
+
+    // Replay pre-lexed tokens. Both vectors have to outlive the stream.
+    TokenStream(const std::vector<Token> &tokens, const std::vector<LiteralValue> &literals)
+        : tokens(&tokens), literals(&literals), token_end(tokens.size())
+    {
+        this->fill(1);
+    }
+
+    // Replay only tokens [token_begin, token_end). literal_begin is the index
+    // of the first literal in that range.
+    TokenStream(const std::vector<Token> &tokens, const std::vector<LiteralValue> &literals,
+                std::size_t token_begin, std::size_t token_end, std::size_t literal_begin)
+        : tokens(&tokens), literals(&literals), token_pos(token_begin), literal_pos(literal_begin), token_end(token_end)
+    {
+        this->fill(1);
+    }
+
+    // Check if all tokens have been used up
+    bool is_at_end() const
+    {
+        return this->head >= this->tail;
+    }
+
+    // Get current token
+    const Token &peek() const
+    {
+        return this->at(this->head).token;
+    }
+
+    // Get previous token
+    const Token &previous() const
+    {
+        return this->at(this->head - 1).token;
+    }
+
+    // Get the payload of the previous token, which must be a number
+    const LiteralValue &previous_literal() const
+    {
+        return this->at(this->head - 1).literal;
+    }
+
+    // Move on to the next token and return the one that was current. At the
+    // end of input the last token is returned again.
+    Token advance()
+    {
+        if (this->is_at_end())
+        {
+            return this->previous();
+        }
+
+        ++this->head;
+        this->fill(1);
+        return this->previous();
+    }
+};
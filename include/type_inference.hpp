@@ -0,0 +1,160 @@
+#pragma once
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+#include "stmt.hpp"
+#include "types.hpp"
+#include "scope_stack.hpp"
+
+// A function compiled for one combination of parameter types. Parameters are
+// untyped in the source, so a function gets an instance per distinct argument
+// types it is called with, and one with int parameters if it is never called.
+struct FunctionInstance
+{
+    static constexpr std::uint32_t none = UINT32_MAX;
+
+    FunctionInstance(const FunctionStmt *fn, std::span<const Type> params)
+        : fn(fn), params(params.begin(), params.end()) {}
+
+    const FunctionStmt *fn;
+    std::vector<Type> params;
+    Type result = Type::Unknown;
+
+    // Next instance of the same function
+    std::uint32_t next = none;
+
+    // Instances that called this one, re-inferred when its result changes
+    std::vector<std::uint32_t> callers;
+    bool queued = false;
+
+    // @tail calls in the body and the instance each went to when this one
+    // was last inferred
+    std::vector<std::pair<const CallExpr *, std::uint32_t>> tail_calls;
+};
+
+// Infers the type of every global, local, parameter and return value.
+//
+// Inference is an optimistic fixpoint over instances: a call to an instance
+// whose result isn't known yet is skipped when typing expressions, and the
+// caller is inferred again once the result is known. Types only ever widen,
+// so this terminates and also types (mutually) recursive functions. Body
+// walks use explicit stacks like the codegen.
+//
+// Locals are scoped to their block. A let of a local declared in an
+// enclosing block assigns it and has to keep its type, so a variable has
+// one type however often a loop runs.
+class TypeInference
+{
+    const SourceManager &sources;
+
+    // Indexed by symbol id
+    std::vector<const FunctionStmt *> functions;
+    std::vector<std::uint32_t> first_instance;
+    std::vector<std::uint32_t> global_ids;
+
+    // Function declarations in source order, for deterministic output
+    std::vector<const FunctionStmt *> declared;
+
+    struct Global
+    {
+        const LetStmt *decl;
+        Type type = Type::Unknown;
+        std::vector<std::uint32_t> readers;
+    };
+    std::vector<Global> globals;
+
+    // Instance 0 stands for the global initializers, which run before main
+    std::vector<FunctionInstance> instances;
+    std::vector<std::uint32_t> worklist;
+    std::uint32_t current = 0;
+
+    // Bindings of the instance being inferred, unbound names are globals
+    ScopeStack<std::optional<Type>> locals;
+
+    std::vector<std::pair<const Expr *, bool>> work;
+    std::vector<Type> types;
+
+    // Joined type of the return statements seen so far in the instance being
+    // inferred, and the first one with a value for error messages
+    Type result = Type::Unknown;
+    bool returns = false;
+    const Expr *typed_return = nullptr;
+
+    // Value of the return statement being inferred, the only place a @tail
+    // call can be
+    const Expr *returned = nullptr;
+
+    static constexpr std::uint32_t no_global = UINT32_MAX;
+
+    std::uint32_t instantiate(const FunctionStmt *fn, std::span<const Type> params);
+    void enqueue(std::uint32_t instance);
+    void infer_instance(std::uint32_t instance);
+    void infer_block(const FunctionStmt *fn, std::span<Stmt *const> statements);
+    void infer_let(const LetStmt *let);
+    void infer_condition(const Expr *condition);
+    void infer_globals();
+    void check_tail_calls() const;
+    void assign_global(const LetStmt *let, Type type);
+    Type infer_expr(const Expr *root);
+    Type infer_call(const CallExpr *call, std::span<const Type> args);
+
+    [[noreturn]] void error(const Expr *expr, const std::string &message) const;
+
+public:
+    // symbols is the table the program was parsed with
+    TypeInference(const SourceManager &sources, const StringInterner &symbols)
+        : sources(sources), functions(symbols.size()),
+          first_instance(symbols.size(), FunctionInstance::none), global_ids(symbols.size(), no_global),
+          locals(symbols.size()) {}
+
+    // Infer every type in program, reporting type errors and exiting
+    void infer(const std::vector<Stmt *> &program);
+
+    bool is_function(SymbolId symbol) const
+    {
+        return this->functions[symbol] != nullptr;
+    }
+
+    bool is_global(SymbolId symbol) const
+    {
+        return this->global_ids[symbol] != no_global;
+    }
+
+    Type global_type(SymbolId symbol) const
+    {
+        return this->globals[this->global_ids[symbol]].type;
+    }
+
+    // Whether fn has instances for more than one set of parameter types
+    bool is_specialized(const FunctionInstance *instance) const
+    {
+        return this->first(instance->fn->symbol)->next != FunctionInstance::none;
+    }
+
+    // Instances of a function in creation order, nullptr after the last
+    const FunctionInstance *first(SymbolId fn) const
+    {
+        std::uint32_t index = this->first_instance[fn];
+        return index == FunctionInstance::none ? nullptr : &this->instances[index];
+    }
+
+    const FunctionInstance *next(const FunctionInstance *instance) const
+    {
+        return instance->next == FunctionInstance::none ? nullptr : &this->instances[instance->next];
+    }
+
+    // Instances are numbered from 0, e.g. for tables indexed by instance
+    std::size_t instance_count() const
+    {
+        return this->instances.size();
+    }
+
+    std::uint32_t index_of(const FunctionInstance *instance) const
+    {
+        return static_cast<std::uint32_t>(instance - this->instances.data());
+    }
+
+    // Instance called with these argument types, nullptr if fn isn't defined
+    const FunctionInstance *find(SymbolId fn, std::span<const Type> args) const;
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+
+// Static type of a value. Unknown only appears while types are being
+// inferred, once inference is done every value has one of the others.
+enum class Type : std::uint8_t
+{
+    Unknown,
+    Void,
+    Int,    // 64-bit integer, QBE `l`
+    Float,  // double, QBE `d`
+    String, // pointer to NUL terminated data, QBE `l`
+    Bool,   // truth value or exit status, QBE `w`, only made by codegen
+};
+
+inline const char *type_name(Type type)
+{
+    switch (type)
+    {
+    case Type::Unknown:
+        return "unknown";
+    case Type::Void:
+        return "void";
+    case Type::Int:
+        return "int";
+    case Type::Float:
+        return "float";
+    case Type::String:
+        return "string";
+    case Type::Bool:
+        return "bool";
+    }
+    return "?";
+}
+
+// QBE class a value of this type lives in
+inline char qbe_class(Type type)
+{
+    return type == Type::Float ? 'd' : type == Type::Bool ? 'w' : 'l';
+}
+
+// Least type both a and b convert to, nothing if they don't mix. Ints widen
+// to floats, Unknown is absorbed since it only means "not inferred yet".
+inline std::optional<Type> join(Type a, Type b)
+{
+    if (a == b || b == Type::Unknown)
+        return a;
+    if (a == Type::Unknown)
+        return b;
+    if ((a == Type::Int && b == Type::Float) || (a == Type::Float && b == Type::Int))
+        return Type::Float;
+    return std::nullopt;
+}
+
+// Result of an arithmetic operator, nothing if the operands aren't numbers
+inline std::optional<Type> arithmetic_type(Type lhs, Type rhs)
+{
+    auto numeric = [](Type type)
+    {
+        return type == Type::Int || type == Type::Float || type == Type::Unknown;
+    };
+
+    if (!numeric(lhs) || !numeric(rhs))
+        return std::nullopt;
+    return join(lhs, rhs);
+}
@@ -0,0 +1,565 @@
+#include "ast_file.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static constexpr char ast_magic[8] = {'J', 'A', 'N', 'K', 'A', 'S', 'T', '\0'};
+
+static std::uint64_t version_hash()
+{
+    // FNV-1a
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+    for (char c : compiler_version)
+    {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+std::uint64_t AstFile::hash_source(std::string_view source)
+{
+    // Multiply-xorshift over 8-byte words, the inputs can be large
+    constexpr std::uint64_t k = 0x9e3779b97f4a7c15ull;
+    std::uint64_t hash = version_hash() ^ (source.size() * k);
+
+    std::size_t i = 0;
+    for (; i + 8 <= source.size(); i += 8)
+    {
+        std::uint64_t word;
+        std::memcpy(&word, source.data() + i, sizeof(word));
+        hash = (hash ^ word) * k;
+        hash ^= hash >> 29;
+    }
+
+    std::uint64_t tail = 0;
+    std::memcpy(&tail, source.data() + i, source.size() - i);
+    hash = (hash ^ tail) * k;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+std::string AstFile::cache_path(const std::string &cache_dir, std::string_view source)
+{
+    std::stringstream name;
+    name << std::hex << AstFile::hash_source(source) << ".jast";
+    return (std::filesystem::path(cache_dir) / name.str()).string();
+}
+
+AstFile::AstFile(AstFile &&other) noexcept
+    : mapping(other.mapping), mapping_size(other.mapping_size), owned(std::move(other.owned)),
+      data(other.data), header(other.header)
+{
+    // The owned buffer moved, so views into it have to be re-pointed
+    if (!this->mapping && !this->owned.empty())
+    {
+        this->data = reinterpret_cast<const std::byte *>(this->owned.data());
+        this->header = reinterpret_cast<const AstFileHeader *>(this->data);
+    }
+    other.mapping = nullptr;
+    other.data = nullptr;
+    other.header = nullptr;
+}
+
+AstFile &AstFile::operator=(AstFile &&other) noexcept
+{
+    if (this != &other)
+    {
+        this->~AstFile();
+        new (this) AstFile(std::move(other));
+    }
+    return *this;
+}
+
+AstFile::~AstFile()
+{
+    this->unmap();
+}
+
+void AstFile::unmap()
+{
+#ifndef _WIN32
+    if (this->mapping)
+    {
+        munmap(this->mapping, this->mapping_size);
+        this->mapping = nullptr;
+    }
+#endif
+}
+
+std::optional<AstFile> AstFile::load(const std::string &path)
+{
+    AstFile file;
+
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return std::nullopt;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(AstFileHeader))
+    {
+        close(fd);
+        return std::nullopt;
+    }
+
+    void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return std::nullopt;
+    }
+    file.mapping = mapping;
+    file.mapping_size = st.st_size;
+    file.data = static_cast<const std::byte *>(mapping);
+#else
+    std::ifstream input(path, std::ios::binary);
+    if (!input.is_open())
+    {
+        return std::nullopt;
+    }
+    std::stringstream content;
+    content << input.rdbuf();
+    file.owned = content.str();
+    file.mapping_size = file.owned.size();
+    if (file.mapping_size < sizeof(AstFileHeader))
+    {
+        return std::nullopt;
+    }
+    file.data = reinterpret_cast<const std::byte *>(file.owned.data());
+#endif
+
+    file.header = reinterpret_cast<const AstFileHeader *>(file.data);
+    if (!file.validate())
+    {
+        return std::nullopt;
+    }
+    return file;
+}
+
+bool AstFile::validate() const
+{
+    const AstFileHeader &h = *this->header;
+    if (std::memcmp(h.magic, ast_magic, sizeof(ast_magic)) != 0 || h.version_hash != version_hash() ||
+        h.file_size != this->mapping_size)
+    {
+        return false;
+    }
+
+    auto fits = [&](std::uint64_t offset, std::uint64_t bytes, std::size_t align)
+    {
+        return offset % align == 0 && offset <= h.file_size && bytes <= h.file_size - offset;
+    };
+
+    if (!fits(h.kinds_offset, h.node_count, 1) ||
+        !fits(h.a_offset, h.node_count * 4ull, 4) ||
+        !fits(h.b_offset, h.node_count * 4ull, 4) ||
+        !fits(h.locs_offset, h.node_count * 4ull, 4) ||
+        !fits(h.extra_offset, h.extra_count * 4ull, 4) ||
+        !fits(h.constants_offset, h.constant_count * 8ull, 8) ||
+        !fits(h.names_offset, (h.name_count + 1ull) * 8, 8) ||
+        !fits(h.roots_offset, h.root_count * 4ull, 4) ||
+        !fits(h.source_offset, h.source_name_size + h.source_size, 1))
+    {
+        return false;
+    }
+
+    // Names are back to back, so their offsets never decrease
+    auto name_offsets = this->section<std::uint64_t>(h.names_offset, h.name_count + 1);
+    for (std::uint32_t i = 0; i < h.name_count; ++i)
+    {
+        if (name_offsets[i] > name_offsets[i + 1])
+        {
+            return false;
+        }
+    }
+    return name_offsets.front() == 0 && fits(h.name_data_offset, name_offsets.back(), 1);
+}
+
+bool AstFile::check_nodes() const
+{
+    const AstFileHeader &h = *this->header;
+    auto kinds = this->section<FlatKind>(h.kinds_offset, h.node_count);
+    auto a = this->section<std::uint32_t>(h.a_offset, h.node_count);
+    auto b = this->section<std::uint32_t>(h.b_offset, h.node_count);
+    auto locs = this->section<std::uint32_t>(h.locs_offset, h.node_count);
+    auto extra = this->section<std::uint32_t>(h.extra_offset, h.extra_count);
+    auto roots = this->section<std::uint32_t>(h.roots_offset, h.root_count);
+
+    auto is_expr = [&](FlatKind kind)
+    {
+        return kind <= FlatKind::TailCall;
+    };
+
+    // Children come before their parent, which also rules out cycles
+    auto expr = [&](NodeIndex i, std::uint32_t child)
+    {
+        return child < i && is_expr(kinds[child]);
+    };
+    auto stmt = [&](NodeIndex i, std::uint32_t child)
+    {
+        return child < i && !is_expr(kinds[child]);
+    };
+    auto block = [&](NodeIndex i, std::uint32_t child)
+    {
+        return child < i && kinds[child] == FlatKind::Block;
+    };
+
+    // Items of the counted list at `start` in extra, nothing if it or the
+    // `trailing` entries after it run past the end
+    using List = std::optional<std::span<const std::uint32_t>>;
+    auto list = [&](std::uint32_t start, std::uint32_t trailing) -> List
+    {
+        if (start >= h.extra_count || extra[start] + 1ull + trailing > h.extra_count - start)
+        {
+            return std::nullopt;
+        }
+        return extra.subspan(start + 1, extra[start]);
+    };
+
+    for (NodeIndex i = 0; i < h.node_count; ++i)
+    {
+        if (kinds[i] > FlatKind::While || locs[i] > h.source_size)
+        {
+            return false;
+        }
+
+        bool valid = true;
+        switch (kinds[i])
+        {
+        case FlatKind::Int:
+        case FlatKind::Float:
+            valid = a[i] < h.constant_count;
+            break;
+        case FlatKind::String:
+        case FlatKind::Identifier:
+            valid = a[i] < h.name_count;
+            break;
+        case FlatKind::Add:
+        case FlatKind::Sub:
+        case FlatKind::Mul:
+        case FlatKind::Div:
+            valid = expr(i, a[i]) && expr(i, b[i]);
+            break;
+        case FlatKind::Call:
+        case FlatKind::TailCall:
+        {
+            List args = list(b[i], 0);
+            valid = a[i] < h.name_count && args &&
+                    std::ranges::all_of(*args, [&](std::uint32_t arg) { return expr(i, arg); });
+            break;
+        }
+        case FlatKind::Let:
+            valid = a[i] < h.name_count && expr(i, b[i]);
+            break;
+        case FlatKind::ExprStmt:
+            valid = expr(i, a[i]);
+            break;
+        case FlatKind::Return:
+            valid = a[i] == no_node || expr(i, a[i]);
+            break;
+        case FlatKind::Block:
+        {
+            List children = list(a[i], 0);
+            valid = children && std::ranges::all_of(*children, [&](std::uint32_t child) { return stmt(i, child); });
+            break;
+        }
+        case FlatKind::Function:
+        {
+            // The body follows the parameter names
+            List params = list(b[i], 1);
+            valid = a[i] < h.name_count && params &&
+                    std::ranges::all_of(*params, [&](std::uint32_t param) { return param < h.name_count; }) &&
+                    block(i, extra[b[i] + 1 + params->size()]);
+            break;
+        }
+        case FlatKind::If:
+            valid = expr(i, a[i]) && b[i] < h.extra_count && h.extra_count - b[i] >= 2 && block(i, extra[b[i]]) &&
+                    (extra[b[i] + 1] == no_node || stmt(i, extra[b[i] + 1]));
+            break;
+        case FlatKind::While:
+            valid = expr(i, a[i]) && block(i, b[i]);
+            break;
+        }
+        if (!valid)
+        {
+            return false;
+        }
+    }
+
+    for (NodeIndex root : roots)
+    {
+        if (!stmt(h.node_count, root))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AstFile::write(const std::string &path, const FlatAst &ast, const SourceManager &sources, FileId file)
+{
+    std::string_view source = sources.get_contents(file);
+    const std::string &source_name = sources.get_name(file);
+    SourceLocation base = sources.get_base(file);
+
+    AstFileHeader h{};
+    std::memcpy(h.magic, ast_magic, sizeof(ast_magic));
+    h.version_hash = version_hash();
+    h.source_hash = AstFile::hash_source(source);
+    h.source_size = source.size();
+    h.node_count = static_cast<std::uint32_t>(ast.size());
+    h.extra_count = static_cast<std::uint32_t>(ast.extra.size());
+    h.constant_count = static_cast<std::uint32_t>(ast.constants.size());
+    h.name_count = static_cast<std::uint32_t>(ast.names.size());
+    h.root_count = static_cast<std::uint32_t>(ast.roots.size());
+    h.source_name_size = static_cast<std::uint32_t>(source_name.size());
+
+    // Locations are stored relative to the file, it may be registered at a
+    // different base next time
+    std::vector<std::uint32_t> locs(ast.locs.size());
+    for (std::size_t i = 0; i < locs.size(); ++i)
+    {
+        locs[i] = ast.locs[i] >= base ? ast.locs[i] - base : 0;
+    }
+
+    std::vector<std::uint64_t> name_offsets = {0};
+    std::string name_data;
+    for (std::size_t i = 0; i < ast.names.size(); ++i)
+    {
+        name_data += ast.names.get_name(static_cast<SymbolId>(i));
+        name_offsets.push_back(name_data.size());
+    }
+
+    // Lay out the sections, each aligned for its element type
+    std::uint64_t offset = sizeof(AstFileHeader);
+    auto place = [&](std::uint64_t bytes, std::uint64_t align)
+    {
+        offset = (offset + align - 1) & ~(align - 1);
+        std::uint64_t start = offset;
+        offset += bytes;
+        return start;
+    };
+    h.kinds_offset = place(ast.kinds.size(), 1);
+    h.a_offset = place(ast.a.size() * 4, 4);
+    h.b_offset = place(ast.b.size() * 4, 4);
+    h.locs_offset = place(locs.size() * 4, 4);
+    h.extra_offset = place(ast.extra.size() * 4, 4);
+    h.constants_offset = place(ast.constants.size() * 8, 8);
+    h.names_offset = place(name_offsets.size() * 8, 8);
+    h.name_data_offset = place(name_data.size(), 1);
+    h.roots_offset = place(ast.roots.size() * 4, 4);
+    h.source_offset = place(source_name.size() + source.size(), 1);
+    h.file_size = offset;
+
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open())
+        {
+            return false;
+        }
+
+        std::uint64_t written = 0;
+        auto put = [&](std::uint64_t at, const void *bytes, std::size_t size)
+        {
+            static constexpr char zeros[8] = {};
+            out.write(zeros, at - written);
+            out.write(static_cast<const char *>(bytes), size);
+            written = at + size;
+        };
+        put(0, &h, sizeof(h));
+        put(h.kinds_offset, ast.kinds.data(), ast.kinds.size());
+        put(h.a_offset, ast.a.data(), ast.a.size() * 4);
+        put(h.b_offset, ast.b.data(), ast.b.size() * 4);
+        put(h.locs_offset, locs.data(), locs.size() * 4);
+        put(h.extra_offset, ast.extra.data(), ast.extra.size() * 4);
+        put(h.constants_offset, ast.constants.data(), ast.constants.size() * 8);
+        put(h.names_offset, name_offsets.data(), name_offsets.size() * 8);
+        put(h.name_data_offset, name_data.data(), name_data.size());
+        put(h.roots_offset, ast.roots.data(), ast.roots.size() * 4);
+        put(h.source_offset, source_name.data(), source_name.size());
+        out.write(source.data(), source.size());
+
+        if (!out)
+        {
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    return !ec;
+}
+
+bool AstFile::matches(std::string_view source) const
+{
+    // The hash only picks the file, the stored text decides, so a collision
+    // can't compile another program
+    return this->header->source_size == source.size() && this->get_source() == source;
+}
+
+std::string_view AstFile::get_source_name() const
+{
+    return {reinterpret_cast<const char *>(this->data + this->header->source_offset), this->header->source_name_size};
+}
+
+std::string_view AstFile::get_source() const
+{
+    return {reinterpret_cast<const char *>(this->data + this->header->source_offset + this->header->source_name_size),
+            this->header->source_size};
+}
+
+std::optional<std::vector<Stmt *>> AstFile::expand(AstArena &arena, StringInterner &symbols,
+                                                   SourceLocation base) const
+{
+    // Checked up front so a bad file leaves no nodes or symbols behind
+    if (!this->check_nodes())
+    {
+        return std::nullopt;
+    }
+
+    const AstFileHeader &h = *this->header;
+    auto kinds = this->section<FlatKind>(h.kinds_offset, h.node_count);
+    auto a = this->section<std::uint32_t>(h.a_offset, h.node_count);
+    auto b = this->section<std::uint32_t>(h.b_offset, h.node_count);
+    auto locs = this->section<std::uint32_t>(h.locs_offset, h.node_count);
+    auto extra = this->section<std::uint32_t>(h.extra_offset, h.extra_count);
+    auto constants = this->section<std::uint64_t>(h.constants_offset, h.constant_count);
+    auto name_offsets = this->section<std::uint64_t>(h.names_offset, h.name_count + 1);
+    auto name_data = reinterpret_cast<const char *>(this->data + h.name_data_offset);
+    auto roots = this->section<std::uint32_t>(h.roots_offset, h.root_count);
+
+    auto name = [&](std::uint32_t id)
+    {
+        return std::string_view(name_data + name_offsets[id], name_offsets[id + 1] - name_offsets[id]);
+    };
+
+    // The name table also holds string literals, so only names actually used
+    // as identifiers are interned
+    std::vector<SymbolId> symbol_ids(h.name_count, UINT32_MAX);
+    auto symbol = [&](std::uint32_t id)
+    {
+        if (symbol_ids[id] == UINT32_MAX)
+        {
+            symbol_ids[id] = symbols.intern(name(id));
+        }
+        return symbol_ids[id];
+    };
+
+    // Nodes are stored children first, so one forward pass sees every child
+    // before its parent
+    std::vector<Expr *> exprs(h.node_count);
+    std::vector<Stmt *> stmts(h.node_count);
+    std::vector<Expr *> expr_list;
+    std::vector<Stmt *> stmt_list;
+    std::vector<std::string_view> param_list;
+    std::vector<SymbolId> param_symbols;
+
+    static constexpr std::string_view ops[] = {"+", "-", "*", "/"};
+
+    for (NodeIndex i = 0; i < h.node_count; ++i)
+    {
+        SourceLocation loc = base + locs[i];
+        switch (kinds[i])
+        {
+        case FlatKind::Int:
+            exprs[i] = arena.make<IntExpr>(static_cast<long>(constants[a[i]]), loc);
+            break;
+        case FlatKind::Float:
+            exprs[i] = arena.make<FloatExpr>(std::bit_cast<double>(constants[a[i]]), loc);
+            break;
+        case FlatKind::String:
+            exprs[i] = arena.make<StringExpr>(name(a[i]), loc);
+            break;
+        case FlatKind::Identifier:
+            exprs[i] = arena.make<IdentifierExpr>(name(a[i]), symbol(a[i]), loc);
+            break;
+        case FlatKind::Add:
+        case FlatKind::Sub:
+        case FlatKind::Mul:
+        case FlatKind::Div:
+        {
+            auto op = ops[static_cast<int>(kinds[i]) - static_cast<int>(FlatKind::Add)];
+            exprs[i] = arena.make<BinaryExpr>(exprs[a[i]], op, exprs[b[i]], loc);
+            break;
+        }
+        case FlatKind::Call:
+        case FlatKind::TailCall:
+        {
+            expr_list.clear();
+            for (std::uint32_t j = 0; j < extra[b[i]]; ++j)
+            {
+                expr_list.push_back(exprs[extra[b[i] + 1 + j]]);
+            }
+            exprs[i] = arena.make<CallExpr>(name(a[i]), symbol(a[i]), arena.copy_array(expr_list), loc,
+                                            kinds[i] == FlatKind::TailCall);
+            break;
+        }
+        case FlatKind::Let:
+            stmts[i] = arena.make<LetStmt>(name(a[i]), symbol(a[i]), exprs[b[i]]);
+            break;
+        case FlatKind::ExprStmt:
+            stmts[i] = arena.make<ExprStmt>(exprs[a[i]]);
+            break;
+        case FlatKind::Return:
+            stmts[i] = arena.make<ReturnStmt>(a[i] == no_node ? nullptr : exprs[a[i]]);
+            break;
+        case FlatKind::Block:
+        {
+            stmt_list.clear();
+            for (std::uint32_t j = 0; j < extra[a[i]]; ++j)
+            {
+                stmt_list.push_back(stmts[extra[a[i] + 1 + j]]);
+            }
+            stmts[i] = arena.make<BlockStmt>(arena.copy_array(stmt_list));
+            break;
+        }
+        case FlatKind::Function:
+        {
+            SymbolId fn_symbol = symbol(a[i]);
+            std::uint32_t count = extra[b[i]];
+            param_list.clear();
+            param_symbols.clear();
+            for (std::uint32_t j = 0; j < count; ++j)
+            {
+                param_list.push_back(name(extra[b[i] + 1 + j]));
+                param_symbols.push_back(symbol(extra[b[i] + 1 + j]));
+            }
+            auto body = static_cast<BlockStmt *>(stmts[extra[b[i] + 1 + count]]);
+            stmts[i] = arena.make<FunctionStmt>(name(a[i]), fn_symbol, arena.copy_array(param_list),
+                                                arena.copy_array(param_symbols), body);
+            break;
+        }
+        case FlatKind::If:
+        {
+            auto then_branch = static_cast<BlockStmt *>(stmts[extra[b[i]]]);
+            Stmt *else_branch = extra[b[i] + 1] == no_node ? nullptr : stmts[extra[b[i] + 1]];
+            stmts[i] = arena.make<IfStmt>(exprs[a[i]], then_branch, else_branch);
+            break;
+        }
+        case FlatKind::While:
+            stmts[i] = arena.make<WhileStmt>(exprs[a[i]], static_cast<BlockStmt *>(stmts[b[i]]));
+            break;
+        }
+    }
+
+    std::vector<Stmt *> program;
+    program.reserve(roots.size());
+    for (NodeIndex root : roots)
+    {
+        program.push_back(stmts[root]);
+    }
+    return program;
+}
@@ -0,0 +1,306 @@
+#include "constant_folder.hpp"
+#include <vector>
+
+void ConstantFolder::run(std::vector<Stmt *> &program)
+{
+    // Globals that fold become static data, so every initializer sees them no
+    // matter where they are declared. Fold until no more of them turn constant.
+    std::vector<LetStmt *> computed;
+    for (Stmt *stmt : program)
+    {
+        if (auto let = as<LetStmt>(stmt))
+        {
+            if (!is_literal(let->value))
+                computed.push_back(let);
+            else if (!this->globals.is_written(let->symbol))
+                this->bind_global(let);
+        }
+    }
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        std::erase_if(computed, [&](LetStmt *let)
+        {
+            this->fold(&let->value);
+            if (!is_literal(let->value))
+                return false;
+
+            if (!this->globals.is_written(let->symbol))
+            {
+                this->bind_global(let);
+                changed = true;
+            }
+            return true;
+        });
+    }
+
+    for (Stmt *stmt : program)
+    {
+        if (auto fn = as<FunctionStmt>(stmt))
+        {
+            this->fold_function(fn);
+        }
+    }
+}
+
+void ConstantFolder::bind_global(const LetStmt *let)
+{
+    this->constants.bind(let->symbol, let->value);
+    this->global_values[let->symbol] = let->value;
+}
+
+void ConstantFolder::fold_function(FunctionStmt *fn)
+{
+    this->constants.push_scope();
+    this->function_depth = this->constants.depth();
+    for (SymbolId param : fn->param_symbols)
+    {
+        this->constants.bind(param, nullptr);
+    }
+
+    // Names let inside a branch or loop may be assigned there, so their
+    // declarations have to stay even if they are constant at first
+    std::vector<SymbolId> nested;
+    for (Stmt *stmt : fn->body->statements)
+    {
+        if (stmt->kind == StmtKind::Let || stmt->kind == StmtKind::Expr || stmt->kind == StmtKind::Return)
+            continue;
+        for_each_statement(std::span<Stmt *const>(&stmt, 1), [&](const Stmt *inner)
+        {
+            if (auto let = as<LetStmt>(inner); let && !this->assigned[let->symbol])
+            {
+                this->assigned[let->symbol] = true;
+                nested.push_back(let->symbol);
+            }
+        });
+    }
+
+    this->fold_block(fn->body);
+    for (SymbolId symbol : nested)
+    {
+        this->assigned[symbol] = false;
+    }
+    this->constants.pop_scope();
+}
+
+void ConstantFolder::fold_block(BlockStmt *block)
+{
+    std::span<Stmt *> statements = block->statements;
+    std::size_t kept = 0;
+    for (Stmt *stmt : statements)
+    {
+        if (Stmt *folded = this->fold_statement(stmt))
+            statements[kept++] = folded;
+    }
+    block->statements = statements.first(kept);
+}
+
+// The statement to keep in place of stmt, nullptr to drop it
+Stmt *ConstantFolder::fold_statement(Stmt *stmt)
+{
+    switch (stmt->kind)
+    {
+    case StmtKind::Let:
+    {
+        auto let = static_cast<LetStmt *>(stmt);
+        this->fold(&let->value);
+        bool constant = is_literal(let->value);
+
+        // Assigning a local of an enclosing block, which has to happen. An int
+        // may be going into a float, so only other literals stay known.
+        if (this->constants.is_outer(let->symbol, this->function_depth))
+        {
+            bool typed = constant && let->value->kind != ExprKind::Int;
+            this->constants.assign(let->symbol, typed ? let->value : nullptr);
+            return let;
+        }
+        if (this->globals.is_global(let->symbol))
+            return let;
+
+        // Every later read is replaced, so a constant let isn't needed
+        this->constants.bind(let->symbol, constant ? let->value : nullptr);
+        return constant && !this->assigned[let->symbol] ? nullptr : let;
+    }
+    case StmtKind::Expr:
+    {
+        auto expr_stmt = static_cast<ExprStmt *>(stmt);
+        this->fold(&expr_stmt->expr);
+        return is_literal(expr_stmt->expr) ? nullptr : expr_stmt;
+    }
+    case StmtKind::Return:
+    {
+        auto ret = static_cast<ReturnStmt *>(stmt);
+        if (ret->value)
+            this->fold(&ret->value);
+        return ret;
+    }
+    case StmtKind::Block:
+        this->constants.push_scope();
+        this->fold_block(static_cast<BlockStmt *>(stmt));
+        this->constants.pop_scope();
+        return stmt;
+    case StmtKind::If:
+    {
+        // A constant condition leaves only the branch it takes
+        auto ifs = static_cast<IfStmt *>(stmt);
+        this->fold(&ifs->condition);
+        if (std::optional<bool> taken = truth(ifs->condition))
+        {
+            Stmt *branch = *taken ? ifs->then_branch : ifs->else_branch;
+            return branch ? this->fold_statement(branch) : nullptr;
+        }
+
+        // Neither branch can rely on what the other assigns, and afterwards
+        // nothing either of them assigns is known
+        this->constants.push_scope();
+        this->fold_block(ifs->then_branch);
+        this->constants.pop_scope();
+        this->forget_assigned(ifs->then_branch);
+        if (ifs->else_branch)
+        {
+            this->constants.push_scope();
+            ifs->else_branch = this->fold_statement(ifs->else_branch);
+            this->constants.pop_scope();
+            if (ifs->else_branch)
+                this->forget_assigned(ifs->else_branch);
+        }
+        return ifs;
+    }
+    case StmtKind::While:
+    {
+        // The condition and body also see what the previous iteration
+        // assigned, so nothing they assign is known inside or after the loop
+        auto loop = static_cast<WhileStmt *>(stmt);
+        this->forget_assigned(loop->body);
+        this->fold(&loop->condition);
+        if (truth(loop->condition) == false)
+            return nullptr;
+
+        this->constants.push_scope();
+        this->fold_block(loop->body);
+        this->constants.pop_scope();
+        this->forget_assigned(loop->body);
+        return loop;
+    }
+    case StmtKind::Function:
+        break;
+    }
+    return stmt;
+}
+
+void ConstantFolder::forget_assigned(Stmt *stmt)
+{
+    for_each_statement(std::span<Stmt *const>(&stmt, 1), [this](const Stmt *inner)
+    {
+        auto let = as<LetStmt>(inner);
+        if (let && this->constants.depth_of(let->symbol) >= this->function_depth)
+            this->constants.assign(let->symbol, nullptr);
+    });
+}
+
+std::optional<bool> ConstantFolder::truth(const Expr *condition)
+{
+    if (auto integer = as<IntExpr>(condition))
+        return integer->value != 0;
+    if (auto floating = as<FloatExpr>(condition))
+        return floating->value != 0;
+    return std::nullopt;
+}
+
+// Post-order from an explicit work stack like the other passes. Children are
+// folded in place before their parent looks at them.
+void ConstantFolder::fold(Expr **root)
+{
+    std::size_t work_base = this->work.size();
+    this->work.push_back({root, false});
+
+    while (this->work.size() > work_base)
+    {
+        auto [slot, children_done] = this->work.back();
+        this->work.pop_back();
+
+        Expr *expr = *slot;
+        switch (expr->kind)
+        {
+        case ExprKind::Int:
+        case ExprKind::Float:
+        case ExprKind::String:
+            break;
+        case ExprKind::Identifier:
+        {
+            auto ident = static_cast<IdentifierExpr *>(expr);
+            if (const Expr *value = this->constants.lookup(ident->symbol))
+            {
+                // A fresh copy, so the tree stays a tree
+                *slot = ConstValue::of(value)->make_literal(this->arena, ident->loc);
+            }
+            break;
+        }
+        case ExprKind::Binary:
+        {
+            auto bin = static_cast<BinaryExpr *>(expr);
+            if (!children_done)
+            {
+                this->work.push_back({slot, true});
+                this->work.push_back({&bin->rhs, false});
+                this->work.push_back({&bin->lhs, false});
+                break;
+            }
+            if (Expr *folded = this->fold_binary(bin))
+            {
+                *slot = folded;
+            }
+            break;
+        }
+        case ExprKind::Call:
+        {
+            auto call = static_cast<CallExpr *>(expr);
+            if (!children_done)
+            {
+                this->work.push_back({slot, true});
+                for (Expr *&arg : call->arguments)
+                {
+                    this->work.push_back({&arg, false});
+                }
+                break;
+            }
+            if (Expr *folded = this->fold_call(call))
+            {
+                *slot = folded;
+            }
+            break;
+        }
+        }
+    }
+}
+
+Expr *ConstantFolder::fold_binary(const BinaryExpr *bin)
+{
+    std::optional<ConstValue> lhs = ConstValue::of(bin->lhs);
+    std::optional<ConstValue> rhs = ConstValue::of(bin->rhs);
+    if (!lhs || !rhs)
+        return nullptr;
+
+    std::optional<ConstValue> result = ConstValue::binary(bin->op[0], *lhs, *rhs);
+    return result ? result->make_literal(this->arena, bin->loc) : nullptr;
+}
+
+Expr *ConstantFolder::fold_call(const CallExpr *call)
+{
+    if (call->name == "println" || !this->globals.is_pure(call->symbol))
+        return nullptr;
+
+    std::vector<ConstValue> args;
+    for (const Expr *arg : call->arguments)
+    {
+        std::optional<ConstValue> value = ConstValue::of(arg);
+        if (!value)
+            return nullptr;
+        args.push_back(*value);
+    }
+
+    std::optional<ConstValue> result = this->evaluator.call(call, args);
+    return result ? result->make_literal(this->arena, call->loc) : nullptr;
+}
@@ -0,0 +1,295 @@
+#include "dead_code.hpp"
+#include <algorithm>
+
+DeadCodeEliminator::Stats DeadCodeEliminator::run(std::vector<Stmt *> &program)
+{
+    Stats stats;
+    const FunctionInstance *user_main = nullptr;
+    for (const Stmt *stmt : program)
+    {
+        if (auto let = as<LetStmt>(stmt))
+        {
+            this->global_lets[let->symbol] = let;
+            stats.globals++;
+        }
+        else if (auto fn = as<FunctionStmt>(stmt))
+        {
+            if (fn->name == "main")
+                user_main = this->types.first(fn->symbol);
+            stats.functions++;
+            for (auto instance = this->types.first(fn->symbol); instance; instance = this->types.next(instance))
+            {
+                stats.instances++;
+            }
+        }
+    }
+
+    // Startup initializers run whether or not their global is read. Ones
+    // without effects are only computed if something needs the value.
+    if (user_main)
+        this->mark_instance(user_main);
+    for (const Stmt *stmt : program)
+    {
+        if (auto let = as<LetStmt>(stmt);
+            let && this->globals.get_storage(let->symbol) == GlobalStorage::Startup && this->has_effects(let->value))
+        {
+            this->mark_global(let->symbol);
+        }
+    }
+
+    // Initializers are walked outside of any function, where parameters
+    // can't shadow the globals they read
+    while (!this->worklist.empty() || !this->initializers.empty())
+    {
+        if (!this->initializers.empty())
+        {
+            const LetStmt *let = this->initializers.back();
+            this->initializers.pop_back();
+            this->walk(let->value);
+            continue;
+        }
+
+        const FunctionInstance *instance = this->worklist.back();
+        this->worklist.pop_back();
+        this->walk_instance(instance);
+    }
+
+    std::erase_if(program, [&](const Stmt *stmt)
+    {
+        if (auto let = as<LetStmt>(stmt))
+            return !this->live_globals[let->symbol];
+        if (auto fn = as<FunctionStmt>(stmt))
+        {
+            bool live = false;
+            for (auto instance = this->types.first(fn->symbol); instance; instance = this->types.next(instance))
+            {
+                live |= this->is_live(instance);
+                stats.live_instances += this->is_live(instance);
+            }
+            return !live;
+        }
+        return false;
+    });
+
+    for (const Stmt *stmt : program)
+    {
+        stats.live_globals += stmt->kind == StmtKind::Let;
+        stats.live_functions += stmt->kind == StmtKind::Function;
+    }
+    return stats;
+}
+
+void DeadCodeEliminator::mark_instance(const FunctionInstance *instance)
+{
+    std::uint32_t index = this->types.index_of(instance);
+    if (!this->reached[index])
+    {
+        this->reached[index] = true;
+        this->worklist.push_back(instance);
+    }
+}
+
+void DeadCodeEliminator::mark_global(SymbolId symbol)
+{
+    if (this->live_globals[symbol])
+        return;
+    this->live_globals[symbol] = true;
+
+    // The initializer runs either way, static values have nothing to walk
+    GlobalStorage storage = this->globals.get_storage(symbol);
+    if (storage == GlobalStorage::Lazy || storage == GlobalStorage::Startup)
+    {
+        this->initializers.push_back(this->global_lets[symbol]);
+    }
+}
+
+void DeadCodeEliminator::walk_instance(const FunctionInstance *instance)
+{
+    const FunctionStmt *fn = instance->fn;
+    this->locals.push_scope();
+    for (std::size_t i = 0; i < fn->params.size(); i++)
+    {
+        this->locals.bind(fn->param_symbols[i], instance->params[i]);
+    }
+
+    this->walk_block(fn->body->statements);
+    this->locals.pop_scope();
+}
+
+// Like codegen, nothing after a return is emitted. Blocks nest as deep as
+// the parser recursed, so they are walked by recursion too.
+void DeadCodeEliminator::walk_block(std::span<Stmt *const> statements)
+{
+    for (const Stmt *stmt : statements)
+    {
+        switch (stmt->kind)
+        {
+        case StmtKind::Let:
+        {
+            // Assigning a local of an enclosing block keeps its type
+            auto let = static_cast<const LetStmt *>(stmt);
+            Type type = this->walk(let->value);
+            if (this->locals.is_outer(let->symbol, 1))
+                break;
+            if (this->globals.is_global(let->symbol))
+                this->mark_global(let->symbol);
+            else
+                this->locals.bind(let->symbol, type);
+            break;
+        }
+        case StmtKind::Expr:
+            this->walk(static_cast<const ExprStmt *>(stmt)->expr);
+            break;
+        case StmtKind::Return:
+            if (auto value = static_cast<const ReturnStmt *>(stmt)->value)
+                this->walk(value);
+            return;
+        case StmtKind::Block:
+            this->locals.push_scope();
+            this->walk_block(static_cast<const BlockStmt *>(stmt)->statements);
+            this->locals.pop_scope();
+            break;
+        case StmtKind::If:
+        {
+            auto ifs = static_cast<const IfStmt *>(stmt);
+            this->walk(ifs->condition);
+            this->locals.push_scope();
+            this->walk_block(ifs->then_branch->statements);
+            this->locals.pop_scope();
+            if (ifs->else_branch)
+            {
+                this->locals.push_scope();
+                this->walk_block(std::span<Stmt *const>(&ifs->else_branch, 1));
+                this->locals.pop_scope();
+            }
+            break;
+        }
+        case StmtKind::While:
+        {
+            auto loop = static_cast<const WhileStmt *>(stmt);
+            this->walk(loop->condition);
+            this->locals.push_scope();
+            this->walk_block(loop->body->statements);
+            this->locals.pop_scope();
+            break;
+        }
+        case StmtKind::Function:
+            break;
+        }
+    }
+}
+
+// Types follow what codegen computes, so each call resolves to the instance
+// that is actually emitted for it
+Type DeadCodeEliminator::walk(const Expr *root)
+{
+    std::size_t work_base = this->work.size();
+    std::size_t value_base = this->values.size();
+
+    this->work.push_back({root, false});
+    while (this->work.size() > work_base)
+    {
+        auto [expr, children_done] = this->work.back();
+        this->work.pop_back();
+
+        switch (expr->kind)
+        {
+        case ExprKind::Int:
+            this->values.push_back(Type::Int);
+            break;
+        case ExprKind::Float:
+            this->values.push_back(Type::Float);
+            break;
+        case ExprKind::String:
+            this->values.push_back(Type::String);
+            break;
+        case ExprKind::Identifier:
+        {
+            SymbolId symbol = static_cast<const IdentifierExpr *>(expr)->symbol;
+            Type local = this->locals.lookup(symbol);
+            if (local != Type::Unknown)
+            {
+                this->values.push_back(local);
+                break;
+            }
+            this->mark_global(symbol);
+            this->values.push_back(this->types.global_type(symbol));
+            break;
+        }
+        case ExprKind::Binary:
+        {
+            auto bin = static_cast<const BinaryExpr *>(expr);
+            if (!children_done)
+            {
+                this->work.push_back({expr, true});
+                this->work.push_back({bin->rhs, false});
+                this->work.push_back({bin->lhs, false});
+                break;
+            }
+            Type rhs = this->values.back();
+            this->values.pop_back();
+            Type lhs = this->values.back();
+            this->values.pop_back();
+            this->values.push_back(arithmetic_type(lhs, rhs).value_or(Type::Int));
+            break;
+        }
+        case ExprKind::Call:
+        {
+            auto call = static_cast<const CallExpr *>(expr);
+            if (!children_done)
+            {
+                this->work.push_back({expr, true});
+                for (std::size_t i = call->arguments.size(); i-- > 0;)
+                {
+                    this->work.push_back({call->arguments[i], false});
+                }
+                break;
+            }
+
+            std::size_t args = this->values.size() - call->arguments.size();
+            if (call->name == "println")
+            {
+                this->values.resize(args);
+                this->values.push_back(Type::Void);
+                break;
+            }
+
+            this->arg_types.assign(this->values.begin() + args, this->values.end());
+            this->values.resize(args);
+            const FunctionInstance *callee = this->types.find(call->symbol, this->arg_types);
+            if (callee)
+                this->mark_instance(callee);
+            this->values.push_back(callee ? callee->result : Type::Int);
+            break;
+        }
+        }
+    }
+
+    Type type = this->values.back();
+    this->values.resize(value_base);
+    return type;
+}
+
+bool DeadCodeEliminator::has_effects(const Expr *root) const
+{
+    std::vector<const Expr *> pending{root};
+    while (!pending.empty())
+    {
+        const Expr *expr = pending.back();
+        pending.pop_back();
+        if (auto bin = as<BinaryExpr>(expr))
+        {
+            if (bin->may_trap())
+                return true;
+            pending.push_back(bin->lhs);
+            pending.push_back(bin->rhs);
+        }
+        else if (expr->kind == ExprKind::Call)
+        {
+            // Even a pure call may trap or never return. The ones that
+            // finish were folded.
+            return true;
+        }
+    }
+    return false;
+}
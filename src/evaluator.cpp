@@ -0,0 +1,351 @@
+#include "evaluator.hpp"
+#include <climits>
+
+std::optional<ConstValue> ConstValue::of(const Expr *literal)
+{
+    switch (literal->kind)
+    {
+    case ExprKind::Int:
+        return ConstValue{Type::Int, static_cast<const IntExpr *>(literal)->value, 0, {}};
+    case ExprKind::Float:
+        return ConstValue{Type::Float, 0, static_cast<const FloatExpr *>(literal)->value, {}};
+    case ExprKind::String:
+        return ConstValue{Type::String, 0, 0, static_cast<const StringExpr *>(literal)->value};
+    default:
+        return std::nullopt;
+    }
+}
+
+std::optional<ConstValue> ConstValue::binary(char op, ConstValue lhs, ConstValue rhs)
+{
+    if (lhs.type == Type::Int && rhs.type == Type::Int)
+    {
+        // Wrap around like the 64-bit instructions do
+        auto a = static_cast<unsigned long>(lhs.integer);
+        auto b = static_cast<unsigned long>(rhs.integer);
+        unsigned long result;
+        switch (op)
+        {
+        case '+':
+            result = a + b;
+            break;
+        case '-':
+            result = a - b;
+            break;
+        case '*':
+            result = a * b;
+            break;
+        case '/':
+            if (rhs.integer == 0 || (lhs.integer == LONG_MIN && rhs.integer == -1))
+                return std::nullopt;
+            result = static_cast<unsigned long>(lhs.integer / rhs.integer);
+            break;
+        default:
+            return std::nullopt;
+        }
+        return ConstValue{Type::Int, static_cast<long>(result), 0, {}};
+    }
+
+    auto number = [](ConstValue value)
+    {
+        return value.type == Type::Int || value.type == Type::Float;
+    };
+    if (!number(lhs) || !number(rhs))
+        return std::nullopt;
+
+    double a = lhs.convert(Type::Float).floating;
+    double b = rhs.convert(Type::Float).floating;
+    double result;
+    switch (op)
+    {
+    case '+':
+        result = a + b;
+        break;
+    case '-':
+        result = a - b;
+        break;
+    case '*':
+        result = a * b;
+        break;
+    case '/':
+        result = a / b;
+        break;
+    default:
+        return std::nullopt;
+    }
+    return ConstValue{Type::Float, 0, result, {}};
+}
+
+ConstValue ConstValue::convert(Type to) const
+{
+    if (this->type == Type::Int && to == Type::Float)
+    {
+        return {Type::Float, 0, static_cast<double>(this->integer), {}};
+    }
+    return *this;
+}
+
+Expr *ConstValue::make_literal(AstArena &arena, SourceLocation loc) const
+{
+    switch (this->type)
+    {
+    case Type::Int:
+        return arena.make<IntExpr>(this->integer, loc);
+    case Type::Float:
+        return arena.make<FloatExpr>(this->floating, loc);
+    case Type::String:
+        return arena.make<StringExpr>(this->string, loc);
+    default:
+        return nullptr;
+    }
+}
+
+std::optional<ConstValue> Evaluator::call(const CallExpr *call, std::span<const ConstValue> args)
+{
+    this->frames.clear();
+    this->blocks.clear();
+    this->bindings.clear();
+    this->work.clear();
+    this->values.clear();
+
+    if (!this->push_frame(call, args))
+        return std::nullopt;
+    return this->run();
+}
+
+bool Evaluator::push_frame(const CallExpr *call, std::span<const ConstValue> args)
+{
+    if (this->frames.size() >= max_depth || !this->globals.is_pure(call->symbol))
+        return false;
+
+    this->arg_types.clear();
+    for (const ConstValue &arg : args)
+    {
+        this->arg_types.push_back(arg.type);
+    }
+    const FunctionInstance *instance = this->types.find(call->symbol, this->arg_types);
+    if (!instance)
+        return false;
+
+    this->frames.push_back({instance, nullptr, this->bindings.size(), this->work.size(), this->blocks.size()});
+    for (std::size_t i = 0; i < args.size(); i++)
+    {
+        this->bindings.push_back({instance->fn->param_symbols[i], args[i]});
+    }
+    this->enter(instance->fn->body->statements);
+
+    // Parameters are in the body's scope
+    this->blocks.back().binding_base = this->frames.back().binding_base;
+    return true;
+}
+
+void Evaluator::enter(std::span<Stmt *const> statements, const WhileStmt *loop)
+{
+    this->blocks.push_back({statements, 0, loop, this->bindings.size()});
+}
+
+// A let of a local bound in an enclosing block of the same call assigns it,
+// converted to its type. Otherwise it declares a new one.
+void Evaluator::bind(SymbolId symbol, ConstValue value)
+{
+    std::size_t scope = this->blocks.back().binding_base;
+    for (std::size_t i = this->bindings.size(); i-- > this->frames.back().binding_base;)
+    {
+        if (this->bindings[i].first != symbol)
+            continue;
+        if (i < scope)
+        {
+            this->bindings[i].second = value.convert(this->bindings[i].second.type);
+            return;
+        }
+        break;
+    }
+    this->bindings.push_back({symbol, value});
+}
+
+bool Evaluator::start(const Stmt *stmt)
+{
+    const Expr *expr = statement_expr(stmt);
+    switch (stmt->kind)
+    {
+    case StmtKind::Block:
+        this->enter(static_cast<const BlockStmt *>(stmt)->statements);
+        return true;
+    case StmtKind::Function:
+        return false;
+    case StmtKind::Return:
+        if (!expr)
+        {
+            this->values.push_back({});
+            break;
+        }
+        this->work.push_back({expr, false});
+        break;
+    default:
+        this->work.push_back({expr, false});
+        break;
+    }
+    this->frames.back().pending = stmt;
+    return true;
+}
+
+std::optional<ConstValue> Evaluator::lookup(SymbolId symbol) const
+{
+    for (std::size_t i = this->bindings.size(); i-- > this->frames.back().binding_base;)
+    {
+        if (this->bindings[i].first == symbol)
+            return this->bindings[i].second;
+    }
+
+    if (const Expr *global = this->global_values[symbol])
+        return ConstValue::of(global);
+    return std::nullopt;
+}
+
+// Statements of the innermost frame run one at a time. A statement's
+// expression is evaluated on the work stack, and a call pushes a frame whose
+// return value lands on the value stack where the call's result belongs.
+std::optional<ConstValue> Evaluator::run()
+{
+    for (std::size_t steps = 0;; steps++)
+    {
+        if (steps == max_steps || this->total_steps == 0)
+            return std::nullopt;
+        this->total_steps--;
+
+        Frame &frame = this->frames.back();
+        if (this->work.size() > frame.work_base)
+        {
+            auto [expr, children_done] = this->work.back();
+            this->work.pop_back();
+
+            switch (expr->kind)
+            {
+            case ExprKind::Int:
+            case ExprKind::Float:
+            case ExprKind::String:
+                this->values.push_back(*ConstValue::of(expr));
+                break;
+            case ExprKind::Identifier:
+            {
+                std::optional<ConstValue> value = this->lookup(static_cast<const IdentifierExpr *>(expr)->symbol);
+                if (!value)
+                    return std::nullopt;
+                this->values.push_back(*value);
+                break;
+            }
+            case ExprKind::Binary:
+            {
+                auto bin = static_cast<const BinaryExpr *>(expr);
+                if (!children_done)
+                {
+                    this->work.push_back({expr, true});
+                    this->work.push_back({bin->rhs, false});
+                    this->work.push_back({bin->lhs, false});
+                    break;
+                }
+
+                ConstValue rhs = this->values.back();
+                this->values.pop_back();
+                ConstValue lhs = this->values.back();
+                this->values.pop_back();
+
+                std::optional<ConstValue> result = ConstValue::binary(bin->op[0], lhs, rhs);
+                if (!result)
+                    return std::nullopt;
+                this->values.push_back(*result);
+                break;
+            }
+            case ExprKind::Call:
+            {
+                auto call = static_cast<const CallExpr *>(expr);
+                if (!children_done)
+                {
+                    this->work.push_back({expr, true});
+                    for (std::size_t i = call->arguments.size(); i-- > 0;)
+                    {
+                        this->work.push_back({call->arguments[i], false});
+                    }
+                    break;
+                }
+
+                std::size_t args = this->values.size() - call->arguments.size();
+                if (!this->push_frame(call, std::span(this->values).subspan(args)))
+                    return std::nullopt;
+                this->values.resize(args);
+                break;
+            }
+            }
+            continue;
+        }
+
+        const FunctionInstance *instance = frame.instance;
+        auto truthy = [](ConstValue value)
+        {
+            return value.type == Type::Float ? value.floating != 0 : value.integer != 0;
+        };
+
+        // The pending statement's expression is done, finish the statement
+        std::optional<ConstValue> returned;
+        if (const Stmt *stmt = frame.pending)
+        {
+            frame.pending = nullptr;
+            ConstValue value = this->values.back();
+            this->values.pop_back();
+
+            switch (stmt->kind)
+            {
+            case StmtKind::Let:
+                this->bind(static_cast<const LetStmt *>(stmt)->symbol, value);
+                break;
+            case StmtKind::Return:
+                returned = value;
+                break;
+            case StmtKind::If:
+            {
+                auto ifs = static_cast<const IfStmt *>(stmt);
+                if (truthy(value))
+                    this->enter(ifs->then_branch->statements);
+                else if (ifs->else_branch && !this->start(ifs->else_branch))
+                    return std::nullopt;
+                break;
+            }
+            case StmtKind::While:
+            {
+                auto loop = static_cast<const WhileStmt *>(stmt);
+                if (truthy(value))
+                    this->enter(loop->body->statements, loop);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+        else if (Block &block = this->blocks.back(); block.next == block.statements.size())
+        {
+            // Leaving the function's body returns nothing
+            const WhileStmt *loop = block.loop;
+            this->bindings.resize(block.binding_base);
+            this->blocks.pop_back();
+            if (this->blocks.size() == frame.block_base)
+                returned = ConstValue{};
+            else if (loop)
+                this->start(loop);
+        }
+        else if (!this->start(block.statements[block.next++]))
+        {
+            return std::nullopt;
+        }
+
+        if (returned)
+        {
+            ConstValue result = returned->convert(instance->result);
+            this->bindings.resize(frame.binding_base);
+            this->blocks.resize(frame.block_base);
+            this->frames.pop_back();
+            if (this->frames.empty())
+                return result;
+            this->values.push_back(result);
+        }
+    }
+}
@@ -0,0 +1,293 @@
+#include "flat_ast.hpp"
+#include <bit>
+
+FlatAst FlatAst::build(const std::vector<Stmt *> &program)
+{
+    FlatAst ast;
+    for (const Stmt *stmt : program)
+    {
+        ast.roots.push_back(ast.flatten(stmt));
+    }
+    return ast;
+}
+
+double FlatAst::float_value(NodeIndex node) const
+{
+    return std::bit_cast<double>(this->constants[this->a[node]]);
+}
+
+NodeIndex FlatAst::add(FlatKind kind, std::uint32_t a, std::uint32_t b, SourceLocation loc)
+{
+    this->kinds.push_back(kind);
+    this->a.push_back(a);
+    this->b.push_back(b);
+    this->locs.push_back(loc);
+    return static_cast<NodeIndex>(this->kinds.size() - 1);
+}
+
+// Post-order from an explicit work stack, so deep expressions can't overflow
+// the native stack. Children are added before their parent either way.
+NodeIndex FlatAst::flatten(const Expr *root)
+{
+    if (!root)
+    {
+        return no_node;
+    }
+
+    std::vector<std::pair<const Expr *, bool>> work = {{root, false}};
+    std::vector<NodeIndex> done;
+
+    while (!work.empty())
+    {
+        auto [expr, children_done] = work.back();
+        work.pop_back();
+
+        switch (expr->kind)
+        {
+        case ExprKind::Int:
+            this->constants.push_back(static_cast<std::uint64_t>(static_cast<const IntExpr *>(expr)->value));
+            done.push_back(this->add(FlatKind::Int, this->constants.size() - 1, 0, expr->loc));
+            break;
+        case ExprKind::Float:
+            this->constants.push_back(std::bit_cast<std::uint64_t>(static_cast<const FloatExpr *>(expr)->value));
+            done.push_back(this->add(FlatKind::Float, this->constants.size() - 1, 0, expr->loc));
+            break;
+        case ExprKind::String:
+            done.push_back(this->add(FlatKind::String, this->names.intern(static_cast<const StringExpr *>(expr)->value), 0, expr->loc));
+            break;
+        case ExprKind::Identifier:
+            done.push_back(this->add(FlatKind::Identifier, this->names.intern(static_cast<const IdentifierExpr *>(expr)->name), 0, expr->loc));
+            break;
+        case ExprKind::Binary:
+        {
+            auto bin = static_cast<const BinaryExpr *>(expr);
+            if (!children_done)
+            {
+                work.push_back({expr, true});
+                work.push_back({bin->rhs, false});
+                work.push_back({bin->lhs, false});
+                break;
+            }
+
+            NodeIndex rhs = done.back();
+            done.pop_back();
+            NodeIndex lhs = done.back();
+            done.pop_back();
+
+            FlatKind kind = FlatKind::Add;
+            if (bin->op == "-")
+                kind = FlatKind::Sub;
+            else if (bin->op == "*")
+                kind = FlatKind::Mul;
+            else if (bin->op == "/")
+                kind = FlatKind::Div;
+
+            done.push_back(this->add(kind, lhs, rhs, expr->loc));
+            break;
+        }
+        case ExprKind::Call:
+        {
+            auto call = static_cast<const CallExpr *>(expr);
+            if (!children_done)
+            {
+                // Flatten arguments first so they precede the call
+                work.push_back({expr, true});
+                for (std::size_t i = call->arguments.size(); i-- > 0;)
+                {
+                    work.push_back({call->arguments[i], false});
+                }
+                break;
+            }
+
+            // Then record them
+            auto start = static_cast<std::uint32_t>(this->extra.size());
+            auto args = done.end() - call->arguments.size();
+            this->extra.push_back(static_cast<std::uint32_t>(call->arguments.size()));
+            this->extra.insert(this->extra.end(), args, done.end());
+            done.erase(args, done.end());
+
+            FlatKind kind = call->tail ? FlatKind::TailCall : FlatKind::Call;
+            done.push_back(this->add(kind, this->names.intern(call->name), start, expr->loc));
+            break;
+        }
+        }
+    }
+
+    return done.back();
+}
+
+NodeIndex FlatAst::flatten(const Stmt *stmt)
+{
+    switch (stmt->kind)
+    {
+    case StmtKind::Let:
+    {
+        auto let = static_cast<const LetStmt *>(stmt);
+        NodeIndex value = this->flatten(let->value);
+        return this->add(FlatKind::Let, this->names.intern(let->name), value, let->value->loc);
+    }
+    case StmtKind::Expr:
+    {
+        auto expr_stmt = static_cast<const ExprStmt *>(stmt);
+        NodeIndex expr = this->flatten(expr_stmt->expr);
+        return this->add(FlatKind::ExprStmt, expr, 0, expr_stmt->expr->loc);
+    }
+    case StmtKind::Return:
+    {
+        auto ret = static_cast<const ReturnStmt *>(stmt);
+        NodeIndex value = this->flatten(ret->value);
+        return this->add(FlatKind::Return, value, 0, ret->value ? ret->value->loc : 0);
+    }
+    case StmtKind::Block:
+    {
+        std::vector<NodeIndex> statements;
+        for (const Stmt *s : static_cast<const BlockStmt *>(stmt)->statements)
+        {
+            statements.push_back(this->flatten(s));
+        }
+
+        auto start = static_cast<std::uint32_t>(this->extra.size());
+        this->extra.push_back(static_cast<std::uint32_t>(statements.size()));
+        this->extra.insert(this->extra.end(), statements.begin(), statements.end());
+
+        return this->add(FlatKind::Block, start, 0, 0);
+    }
+    case StmtKind::Function:
+    {
+        auto fn = static_cast<const FunctionStmt *>(stmt);
+        NodeIndex body = this->flatten(fn->body);
+
+        auto start = static_cast<std::uint32_t>(this->extra.size());
+        this->extra.push_back(static_cast<std::uint32_t>(fn->params.size()));
+        for (std::string_view param : fn->params)
+        {
+            this->extra.push_back(this->names.intern(param));
+        }
+        this->extra.push_back(body);
+
+        return this->add(FlatKind::Function, this->names.intern(fn->name), start, 0);
+    }
+    case StmtKind::If:
+    {
+        auto ifs = static_cast<const IfStmt *>(stmt);
+        NodeIndex condition = this->flatten(ifs->condition);
+        NodeIndex then_branch = this->flatten(ifs->then_branch);
+        NodeIndex else_branch = ifs->else_branch ? this->flatten(ifs->else_branch) : no_node;
+
+        auto start = static_cast<std::uint32_t>(this->extra.size());
+        this->extra.push_back(then_branch);
+        this->extra.push_back(else_branch);
+        return this->add(FlatKind::If, condition, start, ifs->condition->loc);
+    }
+    case StmtKind::While:
+    {
+        auto loop = static_cast<const WhileStmt *>(stmt);
+        NodeIndex condition = this->flatten(loop->condition);
+        NodeIndex body = this->flatten(loop->body);
+        return this->add(FlatKind::While, condition, body, loop->condition->loc);
+    }
+    }
+
+    return no_node;
+}
+
+std::size_t FlatAst::memory_used() const
+{
+    return this->kinds.size() * (sizeof(FlatKind) + 2 * sizeof(std::uint32_t) + sizeof(SourceLocation)) +
+           this->extra.size() * sizeof(std::uint32_t) +
+           this->constants.size() * sizeof(std::uint64_t) +
+           this->roots.size() * sizeof(NodeIndex);
+}
+
+void FlatAst::print(std::ostream &os) const
+{
+    for (NodeIndex root : this->roots)
+    {
+        this->print(os, root, 0);
+    }
+}
+
+void FlatAst::print(std::ostream &os, NodeIndex node, int indent) const
+{
+    if (node == no_node)
+        return;
+
+    for (int i = 0; i < indent; ++i)
+        os << "  ";
+
+    switch (this->kinds[node])
+    {
+    case FlatKind::Int:
+        os << "IntExpr: " << this->int_value(node) << std::endl;
+        break;
+    case FlatKind::Float:
+        os << "FloatExpr: " << this->float_value(node) << std::endl;
+        break;
+    case FlatKind::String:
+        os << "StringExpr: \"" << this->name(node) << "\"" << std::endl;
+        break;
+    case FlatKind::Identifier:
+        os << "IdentifierExpr: " << this->name(node) << std::endl;
+        break;
+    case FlatKind::Add:
+    case FlatKind::Sub:
+    case FlatKind::Mul:
+    case FlatKind::Div:
+    {
+        static constexpr const char *ops[] = {"+", "-", "*", "/"};
+        os << "BinaryExpr: " << ops[static_cast<int>(this->kinds[node]) - static_cast<int>(FlatKind::Add)] << std::endl;
+        this->print(os, this->a[node], indent + 1);
+        this->print(os, this->b[node], indent + 1);
+        break;
+    }
+    case FlatKind::Call:
+    case FlatKind::TailCall:
+        os << "CallExpr: " << this->name(node) << (this->kinds[node] == FlatKind::TailCall ? " @tail" : "") << std::endl;
+        for (NodeIndex arg : this->list(node))
+            this->print(os, arg, indent + 1);
+        break;
+    case FlatKind::Let:
+        os << "LetStmt: " << this->name(node) << " = ";
+        this->print(os, this->b[node], indent);
+        os << std::endl;
+        break;
+    case FlatKind::ExprStmt:
+        os << "ExprStmt:\n";
+        this->print(os, this->a[node], indent + 1);
+        break;
+    case FlatKind::Return:
+        os << "ReturnStmt:\n";
+        this->print(os, this->a[node], indent + 1);
+        break;
+    case FlatKind::Block:
+        os << "BlockStmt:\n";
+        for (NodeIndex stmt : this->list(node))
+            this->print(os, stmt, indent + 1);
+        break;
+    case FlatKind::Function:
+    {
+        os << "FunctionStmt: " << this->name(node) << "(";
+        auto params = this->list(node);
+        for (std::size_t i = 0; i < params.size(); ++i)
+        {
+            os << this->names.get_name(params[i]);
+            if (i + 1 < params.size())
+                os << ", ";
+        }
+        os << ")\n";
+        this->print(os, this->function_body(node), indent + 1);
+        break;
+    }
+    case FlatKind::If:
+        os << "IfStmt:\n";
+        this->print(os, this->a[node], indent + 1);
+        this->print(os, this->extra[this->b[node]], indent + 1);
+        this->print(os, this->extra[this->b[node] + 1], indent + 1);
+        break;
+    case FlatKind::While:
+        os << "WhileStmt:\n";
+        this->print(os, this->a[node], indent + 1);
+        this->print(os, this->b[node], indent + 1);
+        break;
+    }
+}
@@ -0,0 +1,197 @@
+#include "global_analysis.hpp"
+#include <algorithm>
+
+void GlobalAnalysis::propagate(std::vector<bool> &property, std::vector<SymbolId> seeds,
+                               const std::vector<std::pair<SymbolId, SymbolId>> &calls)
+{
+    while (!seeds.empty())
+    {
+        SymbolId callee = seeds.back();
+        seeds.pop_back();
+
+        auto [first, last] = std::ranges::equal_range(calls, callee, {}, &std::pair<SymbolId, SymbolId>::first);
+        for (auto [_, caller] : std::ranges::subrange(first, last))
+        {
+            if (!property[caller])
+            {
+                property[caller] = true;
+                seeds.push_back(caller);
+            }
+        }
+    }
+}
+
+void GlobalAnalysis::analyze(const std::vector<Stmt *> &program)
+{
+    std::vector<const FunctionStmt *> declared;
+    for (const Stmt *stmt : program)
+    {
+        if (auto let = as<LetStmt>(stmt))
+        {
+            this->globals[let->symbol] = true;
+        }
+        else if (auto fn = as<FunctionStmt>(stmt))
+        {
+            this->functions[fn->symbol] = fn;
+            declared.push_back(fn);
+        }
+    }
+
+    // A let of a global's name inside a function assigns the global, unless
+    // a local of an enclosing block has the name. Counting those too only
+    // makes the result more cautious.
+    for (const FunctionStmt *fn : declared)
+    {
+        for_each_statement(fn->body->statements, [this](const Stmt *stmt)
+        {
+            if (auto let = as<LetStmt>(stmt); let && this->globals[let->symbol])
+            {
+                this->written[let->symbol] = true;
+            }
+        });
+    }
+
+    // Find what each function does by itself, and who calls whom
+    std::vector<std::pair<SymbolId, SymbolId>> calls; // callee, caller
+    std::vector<SymbolId> impure, writers;
+    std::vector<const Expr *> pending;
+    for (const FunctionStmt *fn : declared)
+    {
+        auto is_param = [fn](SymbolId symbol)
+        {
+            return std::ranges::find(fn->param_symbols, symbol) != fn->param_symbols.end();
+        };
+
+        bool clean = true;
+        bool writer = false;
+        for_each_statement(fn->body->statements, [&](const Stmt *stmt)
+        {
+            if (auto let = as<LetStmt>(stmt))
+                writer |= this->globals[let->symbol];
+            else if (stmt->kind == StmtKind::Function)
+                clean = false;
+            if (const Expr *expr = statement_expr(stmt))
+                pending.push_back(expr);
+        });
+
+        while (!pending.empty())
+        {
+            const Expr *expr = pending.back();
+            pending.pop_back();
+            switch (expr->kind)
+            {
+            case ExprKind::Identifier:
+            {
+                // Reading a global that changes at run time
+                SymbolId symbol = static_cast<const IdentifierExpr *>(expr)->symbol;
+                clean &= !this->written[symbol] || is_param(symbol);
+                break;
+            }
+            case ExprKind::Binary:
+                pending.push_back(static_cast<const BinaryExpr *>(expr)->lhs);
+                pending.push_back(static_cast<const BinaryExpr *>(expr)->rhs);
+                break;
+            case ExprKind::Call:
+            {
+                auto call = static_cast<const CallExpr *>(expr);
+                if (call->name == "println" || !this->functions[call->symbol])
+                    clean = false;
+                else
+                    calls.push_back({call->symbol, fn->symbol});
+                pending.insert(pending.end(), call->arguments.begin(), call->arguments.end());
+                break;
+            }
+            default:
+                break;
+            }
+        }
+
+        if (!clean || writer)
+            impure.push_back(fn->symbol);
+        if (writer)
+            writers.push_back(fn->symbol);
+    }
+
+    // Then callers inherit it from their callees
+    std::ranges::sort(calls);
+    std::vector<bool> not_pure(this->pure.size());
+    for (SymbolId fn : impure)
+    {
+        not_pure[fn] = true;
+    }
+    propagate(not_pure, std::move(impure), calls);
+    for (const FunctionStmt *fn : declared)
+    {
+        this->pure[fn->symbol] = !not_pure[fn->symbol];
+    }
+
+    for (SymbolId fn : writers)
+    {
+        this->writes[fn] = true;
+    }
+    propagate(this->writes, std::move(writers), calls);
+}
+
+bool GlobalAnalysis::can_initialize_lazily(const Expr *init) const
+{
+    std::vector<const Expr *> pending{init};
+    while (!pending.empty())
+    {
+        const Expr *expr = pending.back();
+        pending.pop_back();
+        switch (expr->kind)
+        {
+        case ExprKind::Identifier:
+        {
+            // Only globals that are ready whenever it runs: static ones and
+            // lazy ones declared before it, which also rules out cycles
+            GlobalStorage other = this->storage[static_cast<const IdentifierExpr *>(expr)->symbol];
+            if (other != GlobalStorage::ReadOnly && other != GlobalStorage::Lazy)
+                return false;
+            break;
+        }
+        case ExprKind::Binary:
+        {
+            auto bin = static_cast<const BinaryExpr *>(expr);
+            if (bin->may_trap())
+                return false;
+            pending.push_back(bin->lhs);
+            pending.push_back(bin->rhs);
+            break;
+        }
+        case ExprKind::Call:
+            // Even a pure call may trap or never return, which would move or
+            // hide with its first use. The ones that finish were folded.
+            return false;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+void GlobalAnalysis::classify(const std::vector<Stmt *> &program)
+{
+    // Static values first, lazy initializers may read any of them
+    for (const Stmt *stmt : program)
+    {
+        if (auto let = as<LetStmt>(stmt))
+        {
+            bool literal = let->value->kind == ExprKind::Int || let->value->kind == ExprKind::Float ||
+                           let->value->kind == ExprKind::String;
+            if (literal)
+                this->storage[let->symbol] = this->written[let->symbol] ? GlobalStorage::Data : GlobalStorage::ReadOnly;
+        }
+    }
+
+    // A global is computed on first use when nothing can tell when that is:
+    // it's never written and its initializer can neither trap nor hang
+    for (const Stmt *stmt : program)
+    {
+        if (auto let = as<LetStmt>(stmt); let && this->storage[let->symbol] == GlobalStorage::None)
+        {
+            bool lazy = !this->written[let->symbol] && this->can_initialize_lazily(let->value);
+            this->storage[let->symbol] = lazy ? GlobalStorage::Lazy : GlobalStorage::Startup;
+        }
+    }
+}
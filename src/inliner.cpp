@@ -0,0 +1,136 @@
+#include "inliner.hpp"
+#include <algorithm>
+#include <cstdint>
+
+std::span<Stmt *const> Inliner::emitted(const FunctionStmt *fn)
+{
+    std::span<Stmt *const> statements = fn->body->statements;
+    auto ret = std::ranges::find(statements, StmtKind::Return, &Stmt::kind);
+    return statements.first(ret == statements.end() ? statements.size() : ret - statements.begin() + 1);
+}
+
+void Inliner::analyze(const std::vector<Stmt *> &program)
+{
+    std::vector<const FunctionStmt *> declared;
+    for (const Stmt *stmt : program)
+    {
+        if (auto fn = as<FunctionStmt>(stmt))
+        {
+            this->functions[fn->symbol] = fn;
+            declared.push_back(fn);
+        }
+    }
+
+    // Size of each function and the calls it makes, one entry per call site
+    std::vector<int> size(declared.size());
+    std::vector<std::vector<std::size_t>> callees(declared.size());
+    std::vector<std::size_t> index(this->functions.size());
+    for (std::size_t i = 0; i < declared.size(); i++)
+    {
+        index[declared[i]->symbol] = i;
+    }
+
+    // Only straight-line code is expanded in place of a call
+    std::vector<bool> branches(declared.size());
+    std::vector<const Expr *> pending;
+    for (std::size_t i = 0; i < declared.size(); i++)
+    {
+        for_each_statement(emitted(declared[i]), [&](const Stmt *stmt)
+        {
+            size[i]++;
+            branches[i] = branches[i] || stmt->kind == StmtKind::If || stmt->kind == StmtKind::While ||
+                          stmt->kind == StmtKind::Block;
+            if (const Expr *expr = statement_expr(stmt))
+                pending.push_back(expr);
+        });
+
+        while (!pending.empty())
+        {
+            const Expr *expr = pending.back();
+            pending.pop_back();
+            size[i]++;
+            if (auto bin = as<BinaryExpr>(expr))
+            {
+                pending.push_back(bin->lhs);
+                pending.push_back(bin->rhs);
+            }
+            else if (auto call = as<CallExpr>(expr))
+            {
+                if (call->name != "println" && this->functions[call->symbol])
+                    callees[i].push_back(index[call->symbol]);
+                pending.insert(pending.end(), call->arguments.begin(), call->arguments.end());
+            }
+        }
+    }
+
+    // Tarjan's strongly connected components with an explicit stack. They
+    // come out callees first, so the cost of every callee outside the
+    // component is known when it is reached.
+    constexpr std::size_t unvisited = SIZE_MAX;
+    std::vector<std::size_t> order(declared.size(), unvisited), low(declared.size());
+    std::vector<bool> on_stack(declared.size());
+    std::vector<std::size_t> component;
+    std::vector<std::pair<std::size_t, std::size_t>> dfs; // function, next callee
+    std::vector<int> cost(declared.size());
+    std::size_t visited = 0;
+
+    for (std::size_t root = 0; root < declared.size(); root++)
+    {
+        if (order[root] != unvisited)
+            continue;
+
+        dfs.push_back({root, 0});
+        order[root] = low[root] = visited++;
+        component.push_back(root);
+        on_stack[root] = true;
+
+        while (!dfs.empty())
+        {
+            auto &[fn, next] = dfs.back();
+            if (next < callees[fn].size())
+            {
+                std::size_t callee = callees[fn][next++];
+                if (order[callee] == unvisited)
+                {
+                    order[callee] = low[callee] = visited++;
+                    component.push_back(callee);
+                    on_stack[callee] = true;
+                    dfs.push_back({callee, 0});
+                }
+                else if (on_stack[callee])
+                {
+                    low[fn] = std::min(low[fn], order[callee]);
+                }
+                continue;
+            }
+
+            std::size_t done = fn;
+            dfs.pop_back();
+            if (!dfs.empty())
+                low[dfs.back().first] = std::min(low[dfs.back().first], low[done]);
+            if (low[done] != order[done])
+                continue;
+
+            // done roots a component, a function calling itself counts as one
+            auto first = std::ranges::find(component, done);
+            bool recursive = component.end() - first > 1 || std::ranges::find(callees[done], done) != callees[done].end();
+            for (auto it = first; it != component.end(); it++)
+            {
+                on_stack[*it] = false;
+            }
+
+            if (!recursive && !branches[done])
+            {
+                const FunctionStmt *decl = declared[done];
+                cost[done] = size[done];
+                for (std::size_t callee : callees[done])
+                {
+                    if (this->inlined[declared[callee]->symbol])
+                        cost[done] += cost[callee] - benefit(declared[callee]);
+                }
+                this->inlined[decl->symbol] = decl->name != "main" && cost[done] - benefit(decl) <= this->threshold;
+            }
+            component.erase(first, component.end());
+        }
+    }
+}
@@ -0,0 +1,892 @@
+#include "ir_lowering.hpp"
+#include <iostream>
+
+void IRLowering::begin_function(std::string name, Type result)
+{
+    this->fn = &this->module.functions.emplace_back();
+    this->fn->name = std::move(name);
+    this->fn->result = result;
+    this->instance = nullptr;
+    this->tail_target = no_block;
+
+    this->variable_types.clear();
+    this->definitions.clear();
+    this->sealed.clear();
+    this->incomplete.clear();
+    this->replaced.clear();
+
+    // Nothing jumps to the entry
+    this->block = this->new_block();
+    this->seal(this->block);
+}
+
+// Removing a trivial phi can make others trivial, e.g. a loop header's phi
+// of itself and that phi, so they are removed until none is left before
+// every use is rewritten
+void IRLowering::finish_function()
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (BlockId block = 0; block < this->fn->blocks.size(); block++)
+        {
+            for (std::size_t i = 0; i < this->fn->blocks[block].phis.size(); i++)
+            {
+                IROperand phi = IROperand::value(this->fn->blocks[block].phis[i].result);
+                if (this->resolve(phi) == phi && this->remove_trivial_phi(block, i) != phi)
+                    changed = true;
+            }
+        }
+    }
+
+    for (IRBlock &code : this->fn->blocks)
+    {
+        std::erase_if(code.phis, [this](const IRInstruction &phi)
+        {
+            IROperand value = IROperand::value(phi.result);
+            return this->resolve(value) != value;
+        });
+        for (IRInstruction &inst : code.instructions)
+        {
+            inst.a = this->resolve(inst.a);
+            inst.b = this->resolve(inst.b);
+        }
+        code.value = this->resolve(code.value);
+    }
+    for (IROperand &arg : this->fn->arguments)
+    {
+        arg = this->resolve(arg);
+    }
+}
+
+BlockId IRLowering::new_block()
+{
+    this->sealed.push_back(false);
+    this->incomplete.emplace_back();
+    return this->fn->new_block();
+}
+
+void IRLowering::jump(BlockId to)
+{
+    if (this->block == no_block)
+        return;
+    IRBlock &code = this->fn->blocks[this->block];
+    code.exit = IRBlock::Exit::Jump;
+    code.target = to;
+    this->fn->blocks[to].predecessors.push_back(this->block);
+}
+
+void IRLowering::branch(IROperand condition, BlockId then_block, BlockId else_block)
+{
+    IRBlock &code = this->fn->blocks[this->block];
+    code.exit = IRBlock::Exit::Branch;
+    code.value = condition;
+    code.target = then_block;
+    code.otherwise = else_block;
+    this->fn->blocks[then_block].predecessors.push_back(this->block);
+    this->fn->blocks[else_block].predecessors.push_back(this->block);
+}
+
+IRLowering::VariableId IRLowering::new_variable(Type type)
+{
+    this->variable_types.push_back(type);
+    return static_cast<VariableId>(this->variable_types.size() - 1);
+}
+
+void IRLowering::write_variable(VariableId variable, BlockId block, IROperand value)
+{
+    this->definitions[std::uint64_t{variable} << 32 | block] = value;
+}
+
+IROperand IRLowering::read_variable(VariableId variable, BlockId block)
+{
+    auto it = this->definitions.find(std::uint64_t{variable} << 32 | block);
+    if (it != this->definitions.end())
+        return this->resolve(it->second);
+    return this->read_variable_recursive(variable, block);
+}
+
+IROperand IRLowering::read_variable_recursive(VariableId variable, BlockId block)
+{
+    auto add_phi = [&]
+    {
+        Type type = this->variable_types[variable];
+        IRInstruction phi{.op = Opcode::Phi, .type = type, .result = this->fn->new_value(type)};
+        this->fn->blocks[block].phis.push_back(phi);
+        return this->fn->blocks[block].phis.size() - 1;
+    };
+
+    IROperand value;
+    const std::vector<BlockId> &predecessors = this->fn->blocks[block].predecessors;
+    if (!this->sealed[block])
+    {
+        // Completed once every predecessor is known
+        std::size_t phi = add_phi();
+        this->incomplete[block].push_back({variable, phi});
+        value = IROperand::value(this->fn->blocks[block].phis[phi].result);
+    }
+    else if (predecessors.size() == 1)
+    {
+        value = this->read_variable(variable, predecessors[0]);
+    }
+    else
+    {
+        // Defined before its operands are read, which ends the search
+        // around a loop
+        std::size_t phi = add_phi();
+        this->write_variable(variable, block, IROperand::value(this->fn->blocks[block].phis[phi].result));
+        value = this->add_phi_operands(variable, block, phi);
+    }
+    this->write_variable(variable, block, value);
+    return value;
+}
+
+IROperand IRLowering::add_phi_operands(VariableId variable, BlockId block, std::size_t phi)
+{
+    std::vector<IROperand> operands;
+    for (std::size_t i = 0; i < this->fn->blocks[block].predecessors.size(); i++)
+    {
+        operands.push_back(this->read_variable(variable, this->fn->blocks[block].predecessors[i]));
+    }
+
+    IRInstruction &inst = this->fn->blocks[block].phis[phi];
+    inst.first_arg = static_cast<std::uint32_t>(this->fn->arguments.size());
+    inst.arg_count = static_cast<std::uint32_t>(operands.size());
+    this->fn->arguments.insert(this->fn->arguments.end(), operands.begin(), operands.end());
+    return this->remove_trivial_phi(block, phi);
+}
+
+// A phi whose operands are all one value or itself is that value. Returns
+// the phi itself if it merges more than that.
+IROperand IRLowering::remove_trivial_phi(BlockId block, std::size_t phi)
+{
+    const IRInstruction &inst = this->fn->blocks[block].phis[phi];
+    IROperand self = IROperand::value(inst.result);
+    IROperand same;
+    for (std::uint32_t i = 0; i < inst.arg_count; i++)
+    {
+        IROperand operand = this->resolve(this->fn->arguments[inst.first_arg + i]);
+        if (operand == same || operand == self)
+            continue;
+        if (same.kind != IROperand::None)
+            return self;
+        same = operand;
+    }
+
+    // Only unreachable code reads a variable nothing defined
+    if (same.kind == IROperand::None)
+        same = inst.type == Type::Float ? IROperand::constant(0.0) : IROperand::constant(0L);
+
+    this->replaced.resize(this->fn->value_types.size());
+    this->replaced[inst.result] = same;
+    return same;
+}
+
+void IRLowering::seal(BlockId block)
+{
+    for (std::size_t i = 0; i < this->incomplete[block].size(); i++)
+    {
+        auto [variable, phi] = this->incomplete[block][i];
+        this->add_phi_operands(variable, block, phi);
+    }
+    this->incomplete[block].clear();
+    this->sealed[block] = true;
+}
+
+IROperand IRLowering::resolve(IROperand operand) const
+{
+    while (operand.kind == IROperand::Value && operand.id < this->replaced.size() &&
+           this->replaced[operand.id].kind != IROperand::None)
+    {
+        operand = this->replaced[operand.id];
+    }
+    return operand;
+}
+
+IROperand IRLowering::emit(IRInstruction inst)
+{
+    // Stores are typed by the value they store but have no result
+    if (inst.type != Type::Void && inst.op != Opcode::Store)
+    {
+        inst.result = this->fn->new_value(inst.type);
+    }
+    this->fn->blocks[this->block].instructions.push_back(inst);
+    return inst.result == IRInstruction::none ? IROperand{} : IROperand::value(inst.result);
+}
+
+IROperand IRLowering::emit(Opcode op, Type type, IROperand a, IROperand b)
+{
+    return this->emit(IRInstruction{.op = op, .type = type, .a = a, .b = b});
+}
+
+IROperand IRLowering::emit_call(IRInstruction call, std::span<const IROperand> args)
+{
+    call.op = Opcode::Call;
+    call.first_arg = static_cast<std::uint32_t>(this->fn->arguments.size());
+    call.arg_count = static_cast<std::uint32_t>(args.size());
+    this->fn->arguments.insert(this->fn->arguments.end(), args.begin(), args.end());
+    return this->emit(call);
+}
+
+IROperand IRLowering::string_constant(std::string_view text)
+{
+    auto [it, inserted] = this->string_ids.try_emplace(std::string(text), static_cast<std::uint32_t>(this->module.strings.size()));
+    if (inserted)
+    {
+        this->module.strings.push_back(it->first);
+    }
+    return {IROperand::String, it->second, 0};
+}
+
+IROperand IRLowering::convert(IROperand value, Type type)
+{
+    if (this->fn->type_of(value) != Type::Int || type != Type::Float)
+        return value;
+    if (value.kind == IROperand::Int)
+        return IROperand::constant(static_cast<double>(static_cast<long>(value.bits)));
+    return this->emit(Opcode::IntToFloat, Type::Float, value);
+}
+
+// Functions compiled for several parameter types get one letter per
+// parameter appended
+std::string_view IRLowering::function_name(const FunctionInstance *instance)
+{
+    std::string_view &cached = this->instance_names[this->types.index_of(instance)];
+    if (!cached.empty())
+        return cached;
+
+    std::string_view decl = instance->fn->name;
+    std::string name(decl == "main" ? "_jank_user_main" : decl);
+    if (this->types.is_specialized(instance))
+    {
+        name += '.';
+        for (Type param : instance->params)
+        {
+            name += param == Type::Float ? 'f' : param == Type::String ? 's' : 'i';
+        }
+    }
+    cached = this->module.names.emplace_back(std::move(name));
+    return cached;
+}
+
+// Contents of a global with a static value. Strings point to their bytes,
+// which are added as read-only data of their own.
+std::string IRLowering::global_data(const LetStmt *let)
+{
+    const Expr *init = let->value;
+    switch (init->kind)
+    {
+    case ExprKind::Int:
+        if (this->types.global_type(let->symbol) == Type::Float)
+            return "d " + float_literal(static_cast<double>(static_cast<const IntExpr *>(init)->value));
+        return "l " + std::to_string(static_cast<const IntExpr *>(init)->value);
+    case ExprKind::Float:
+        return "d " + float_literal(static_cast<const FloatExpr *>(init)->value);
+    case ExprKind::String:
+    {
+        std::string bytes = ".str." + std::string(let->name);
+        this->module.data.push_back({bytes, IRData::Section::ReadOnly, "b \"" + std::string(static_cast<const StringExpr *>(init)->value) + "\\00\""});
+        return "l $" + bytes;
+    }
+    default:
+        this->error(init, "Unsupported global initializer.");
+    }
+}
+
+void IRLowering::lower_program(const std::vector<Stmt *> &program)
+{
+    // Data of every global first, functions are collected on the way
+    std::vector<const LetStmt *> startup;
+    std::vector<const LetStmt *> lazy;
+    std::vector<const FunctionStmt *> functions;
+    for (const Stmt *stmt : program)
+    {
+        if (auto decl = as<FunctionStmt>(stmt))
+        {
+            functions.push_back(decl);
+            continue;
+        }
+        auto let = as<LetStmt>(stmt);
+        if (!let)
+            continue;
+
+        std::string name(let->name);
+        GlobalStorage storage = this->globals.get_storage(let->symbol);
+        if (storage == GlobalStorage::ReadOnly || storage == GlobalStorage::Data)
+        {
+            // Strings add their bytes first, the pointer goes before them.
+            // A pointer is relocated when the program loads, so even a
+            // read-only one can't go in .rodata.
+            std::size_t index = this->module.data.size();
+            std::string contents = this->global_data(let);
+            IRData::Section section = IRData::Section::Data;
+            if (storage == GlobalStorage::ReadOnly)
+                section = as<StringExpr>(let->value) ? IRData::Section::RelRo : IRData::Section::ReadOnly;
+            this->module.data.insert(this->module.data.begin() + index, {name, section, contents});
+            continue;
+        }
+
+        // Zero until it is computed
+        Type type = this->types.global_type(let->symbol);
+        this->module.data.push_back({name, IRData::Section::Data, std::string(1, qbe_class(type)) + (type == Type::Float ? " d_0" : " 0")});
+        if (storage == GlobalStorage::Lazy)
+        {
+            this->module.data.push_back({".ready." + name, IRData::Section::Data, "w 0"});
+            lazy.push_back(let);
+        }
+        else
+        {
+            startup.push_back(let);
+        }
+    }
+
+    const FunctionInstance *user_main = nullptr;
+    for (const FunctionStmt *decl : functions)
+    {
+        if (decl->name == "main")
+            user_main = this->types.first(decl->symbol);
+        for (const FunctionInstance *instance = this->types.first(decl->symbol); instance; instance = this->types.next(instance))
+        {
+            if (this->reachable.is_live(instance))
+                this->lower_function(instance);
+        }
+    }
+
+    if (!user_main)
+        throw std::runtime_error("Mandatory function 'main' not found.");
+
+    for (const LetStmt *let : lazy)
+    {
+        this->lower_lazy_global(let);
+    }
+    this->lower_entry(startup, user_main);
+}
+
+void IRLowering::lower_function(const FunctionInstance *instance)
+{
+    const FunctionStmt *decl = instance->fn;
+    this->begin_function(std::string(this->function_name(instance)), instance->result);
+    this->instance = instance;
+
+    this->locals.push_scope();
+    this->function_depth = this->locals.depth();
+    this->param_variables.clear();
+    for (std::size_t i = 0; i < decl->params.size(); i++)
+    {
+        this->fn->params.push_back(decl->param_symbols[i]);
+        IROperand value = IROperand::value(this->fn->new_value(instance->params[i]));
+        VariableId variable = this->new_variable(instance->params[i]);
+        this->write_variable(variable, this->block, value);
+        this->locals.bind(decl->param_symbols[i], variable);
+        this->param_variables.push_back(variable);
+    }
+
+    // Tail calls need a block to jump back to that isn't the entry, its
+    // phis merge the parameters with the arguments of every tail call
+    bool tail_calls = false;
+    for_each_statement(decl->body->statements, [&](const Stmt *stmt)
+    {
+        auto ret = as<ReturnStmt>(stmt);
+        auto call = ret ? as<CallExpr>(ret->value) : nullptr;
+        tail_calls |= call && call->symbol == decl->symbol;
+    });
+    if (tail_calls)
+    {
+        this->tail_target = this->new_block();
+        this->jump(this->tail_target);
+        this->block = this->tail_target;
+    }
+
+    // Only void functions can run off the end
+    this->lower_block(decl->body->statements, instance->result);
+    if (this->tail_target != no_block)
+        this->seal(this->tail_target);
+    this->locals.pop_scope();
+    this->finish_function();
+}
+
+// A global computed on first use. Its getter runs the initializer once,
+// guarded by a flag, and returns the stored value afterwards.
+void IRLowering::lower_lazy_global(const LetStmt *let)
+{
+    Type type = this->types.global_type(let->symbol);
+    IROperand target{IROperand::Global, let->symbol, 0};
+    IROperand ready{IROperand::Ready, let->symbol, 0};
+
+    this->begin_function(".get." + std::string(let->name), type);
+    BlockId init = this->new_block();
+    BlockId done = this->new_block();
+    this->branch(this->emit(Opcode::Load, Type::Bool, ready), done, init);
+
+    this->block = init;
+    IROperand value = this->convert(this->lower_expr(let->value), type);
+    this->emit(IRInstruction{.op = Opcode::Store, .type = type, .a = value, .b = target, .invariant = true});
+    this->emit(Opcode::Store, Type::Bool, IROperand::constant(1L), ready);
+    this->fn->blocks[init].value = value;
+
+    this->block = done;
+    this->fn->blocks[done].value = this->emit(Opcode::Load, type, target);
+}
+
+// The real program entry point: computes the startup globals and calls the
+// user's main, whose result is the exit status
+void IRLowering::lower_entry(const std::vector<const LetStmt *> &startup, const FunctionInstance *user_main)
+{
+    this->begin_function("main", Type::Bool);
+    this->fn->exported = true;
+
+    for (const LetStmt *let : startup)
+    {
+        Type type = this->types.global_type(let->symbol);
+        IROperand value = this->convert(this->lower_expr(let->value), type);
+        this->emit(IRInstruction{.op = Opcode::Store, .type = type, .a = value, .b = {IROperand::Global, let->symbol, 0},
+                                 .invariant = !this->globals.is_written(let->symbol)});
+    }
+
+    IRInstruction call{.op = Opcode::Call, .type = user_main->result, .callee = user_main,
+                       .name = this->function_name(user_main)};
+    IROperand result = this->emit_call(call, {});
+
+    IROperand status = IROperand::constant(0L);
+    if (user_main->result == Type::Int)
+        status = this->emit(Opcode::Copy, Type::Bool, result);
+    else if (user_main->result == Type::Float)
+        status = this->emit(Opcode::FloatToInt, Type::Bool, result);
+    this->fn->blocks[this->block].value = status;
+}
+
+void IRLowering::lower_block(std::span<Stmt *const> statements, Type result)
+{
+    for (const Stmt *stmt : statements)
+    {
+        // Nothing after a return is reachable
+        if (this->block == no_block)
+            return;
+
+        switch (stmt->kind)
+        {
+        case StmtKind::Let:
+            this->lower_let(static_cast<const LetStmt *>(stmt));
+            break;
+        case StmtKind::Expr:
+            this->lower_expr(static_cast<const ExprStmt *>(stmt)->expr);
+            break;
+        case StmtKind::Return:
+        {
+            auto ret = static_cast<const ReturnStmt *>(stmt);
+            if (auto call = as<CallExpr>(ret->value); call && this->tail_target != no_block &&
+                                                       call->symbol == this->instance->fn->symbol)
+            {
+                this->lower_tail_call(call);
+                break;
+            }
+            IROperand value = ret->value ? this->convert(this->lower_expr(ret->value), result) : IROperand{};
+            this->fn->blocks[this->block].value = value;
+            this->block = no_block;
+            break;
+        }
+        case StmtKind::Block:
+            this->lower_scoped(static_cast<const BlockStmt *>(stmt)->statements, result);
+            break;
+        case StmtKind::If:
+            this->lower_if(static_cast<const IfStmt *>(stmt), result);
+            break;
+        case StmtKind::While:
+            this->lower_while(static_cast<const WhileStmt *>(stmt), result);
+            break;
+        case StmtKind::Function:
+            throw std::runtime_error("Unknown statement in codegen");
+        }
+    }
+}
+
+void IRLowering::lower_scoped(std::span<Stmt *const> statements, Type result)
+{
+    this->locals.push_scope();
+    this->lower_block(statements, result);
+    this->locals.pop_scope();
+}
+
+IROperand IRLowering::lower_condition(const Expr *condition)
+{
+    IROperand value = this->lower_expr(condition);
+    if (value.kind == IROperand::Float)
+        return IROperand::constant(std::bit_cast<double>(value.bits) != 0 ? 1L : 0L);
+    if (value.kind == IROperand::Int)
+        return IROperand::constant(value.bits != 0 ? 1L : 0L);
+
+    IROperand zero = this->fn->type_of(value) == Type::Float ? IROperand::constant(0.0) : IROperand::constant(0L);
+    return this->emit(Opcode::Ne, Type::Bool, value, zero);
+}
+
+// A constant condition only lowers the branch it takes. Otherwise both
+// branches meet in a join block, unless neither gets to its end.
+void IRLowering::lower_if(const IfStmt *ifs, Type result)
+{
+    IROperand condition = this->lower_condition(ifs->condition);
+    if (condition.is_constant())
+    {
+        if (condition.bits)
+            this->lower_scoped(ifs->then_branch->statements, result);
+        else if (ifs->else_branch)
+            this->lower_scoped(std::span<Stmt *const>(&ifs->else_branch, 1), result);
+        return;
+    }
+
+    BlockId then_block = this->new_block();
+    BlockId else_block = this->new_block();
+    this->branch(condition, then_block, else_block);
+    this->seal(then_block);
+
+    this->block = then_block;
+    this->lower_scoped(ifs->then_branch->statements, result);
+    BlockId then_end = this->block;
+
+    // Without an else, the else block is where the branches meet
+    if (!ifs->else_branch)
+    {
+        this->jump(else_block);
+        this->seal(else_block);
+        this->block = else_block;
+        return;
+    }
+
+    this->seal(else_block);
+    this->block = else_block;
+    this->lower_scoped(std::span<Stmt *const>(&ifs->else_branch, 1), result);
+    BlockId else_end = this->block;
+    if (then_end == no_block && else_end == no_block)
+        return;
+
+    BlockId join = this->new_block();
+    this->block = then_end;
+    this->jump(join);
+    this->block = else_end;
+    this->jump(join);
+    this->seal(join);
+    this->block = join;
+}
+
+// The header tests the condition and is entered from the block before the
+// loop and from the end of the body, so it is only sealed once the body is
+// lowered. A loop whose condition is a nonzero constant only ends by
+// returning.
+void IRLowering::lower_while(const WhileStmt *loop, Type result)
+{
+    BlockId header = this->new_block();
+    this->jump(header);
+    this->block = header;
+    IROperand condition = this->lower_condition(loop->condition);
+    if (condition.is_constant() && !condition.bits)
+    {
+        this->seal(header);
+        return;
+    }
+
+    BlockId body = this->new_block();
+    BlockId exit = no_block;
+    if (condition.is_constant())
+    {
+        this->jump(body);
+    }
+    else
+    {
+        exit = this->new_block();
+        this->branch(condition, body, exit);
+    }
+    this->seal(body);
+
+    this->block = body;
+    this->lower_scoped(loop->body->statements, result);
+    this->jump(header);
+    this->seal(header);
+
+    this->block = exit;
+    if (exit != no_block)
+        this->seal(exit);
+}
+
+void IRLowering::lower_let(const LetStmt *let)
+{
+    IROperand value = this->lower_expr(let->value);
+
+    // A local of an enclosing block, a global, or a new local
+    VariableId variable = this->locals.lookup(let->symbol);
+    if (variable != no_variable && this->locals.is_outer(let->symbol, this->function_depth))
+    {
+        Type type = this->variable_types[variable];
+        this->write_variable(variable, this->block, this->emit(Opcode::Copy, type, this->convert(value, type)));
+    }
+    else if (this->types.is_global(let->symbol))
+    {
+        Type type = this->types.global_type(let->symbol);
+        this->emit(Opcode::Store, type, this->convert(value, type), {IROperand::Global, let->symbol, 0});
+    }
+    else
+    {
+        Type type = this->fn->type_of(value);
+        variable = this->new_variable(type);
+        this->locals.bind(let->symbol, variable);
+        this->write_variable(variable, this->block, this->emit(Opcode::Copy, type, value));
+    }
+}
+
+// A call of the function being lowered that it returns. The instance it
+// calls is only the one being lowered if the argument types match, a call
+// of another instance is returned as usual. TypeInference already rejected
+// @tail calls of another instance.
+void IRLowering::lower_tail_call(const CallExpr *call)
+{
+    std::vector<IROperand> args;
+    std::vector<Type> arg_types;
+    for (const Expr *arg : call->arguments)
+    {
+        args.push_back(this->lower_expr(arg));
+        arg_types.push_back(this->fn->type_of(args.back()));
+    }
+
+    if (this->types.find(call->symbol, arg_types) != this->instance)
+    {
+        IROperand value = this->convert(this->lower_call(call, args), this->instance->result);
+        this->fn->blocks[this->block].value = value;
+        this->block = no_block;
+        return;
+    }
+
+    // Every argument is computed before any parameter changes
+    for (std::size_t i = 0; i < args.size(); i++)
+    {
+        this->write_variable(this->param_variables[i], this->block, args[i]);
+    }
+    this->jump(this->tail_target);
+    this->block = no_block;
+}
+
+// Expressions are lowered in post-order from an explicit work stack rather
+// than by recursion, so arbitrarily deep or long expressions can't overflow
+// the native stack. Operands wait on `values` until their parent is lowered.
+IROperand IRLowering::lower_expr(const Expr *root)
+{
+    std::size_t work_base = this->work.size();
+    std::size_t value_base = this->values.size();
+
+    this->work.push_back({root, false});
+    while (this->work.size() > work_base)
+    {
+        auto [expr, children_done] = this->work.back();
+        this->work.pop_back();
+
+        switch (expr->kind)
+        {
+        case ExprKind::Binary:
+        {
+            auto bin = static_cast<const BinaryExpr *>(expr);
+            if (children_done)
+            {
+                IROperand rhs = this->values.back();
+                this->values.pop_back();
+                IROperand lhs = this->values.back();
+                this->values.pop_back();
+                this->values.push_back(this->lower_binary(bin, lhs, rhs));
+                break;
+            }
+            this->work.push_back({expr, true});
+            this->work.push_back({bin->rhs, false});
+            this->work.push_back({bin->lhs, false});
+            break;
+        }
+        case ExprKind::Call:
+        {
+            auto call = static_cast<const CallExpr *>(expr);
+            if (children_done)
+            {
+                std::size_t args = this->values.size() - call->arguments.size();
+                IROperand result = this->lower_call(call, std::span(this->values).subspan(args));
+                this->values.resize(args);
+                this->values.push_back(result);
+                break;
+            }
+            this->work.push_back({expr, true});
+            for (std::size_t i = call->arguments.size(); i-- > 0;)
+            {
+                this->work.push_back({call->arguments[i], false});
+            }
+            break;
+        }
+        case ExprKind::Int:
+            this->values.push_back(IROperand::constant(static_cast<const IntExpr *>(expr)->value));
+            break;
+        case ExprKind::Float:
+            this->values.push_back(IROperand::constant(static_cast<const FloatExpr *>(expr)->value));
+            break;
+        case ExprKind::String:
+            this->values.push_back(this->string_constant(static_cast<const StringExpr *>(expr)->value));
+            break;
+        case ExprKind::Identifier:
+            this->values.push_back(this->lower_identifier(static_cast<const IdentifierExpr *>(expr)));
+            break;
+        }
+    }
+
+    IROperand result = this->values.back();
+    this->values.resize(value_base);
+    return result;
+}
+
+IROperand IRLowering::lower_identifier(const IdentifierExpr *ident)
+{
+    VariableId variable = this->locals.lookup(ident->symbol);
+    if (variable != no_variable)
+    {
+        return this->read_variable(variable, this->block);
+    }
+
+    // Lazy globals are read through their getter
+    Type type = this->types.global_type(ident->symbol);
+    IROperand address{IROperand::Global, ident->symbol, 0};
+    if (this->globals.get_storage(ident->symbol) == GlobalStorage::Lazy)
+        return this->emit(Opcode::Get, type, address);
+    return this->emit(IRInstruction{.op = Opcode::Load, .type = type, .a = address,
+                                    .invariant = !this->globals.is_written(ident->symbol)});
+}
+
+IROperand IRLowering::lower_binary(const BinaryExpr *bin, IROperand lhs, IROperand rhs)
+{
+    Opcode op;
+    if (bin->op == "+")
+        op = Opcode::Add;
+    else if (bin->op == "-")
+        op = Opcode::Sub;
+    else if (bin->op == "*")
+        op = Opcode::Mul;
+    else if (bin->op == "/")
+        op = Opcode::Div;
+    else
+        this->error(bin, "Unsupported binary operator: " + std::string(bin->op));
+
+    // Mixed operands compute in floating point
+    Type type = *arithmetic_type(this->fn->type_of(lhs), this->fn->type_of(rhs));
+    lhs = this->convert(lhs, type);
+    rhs = this->convert(rhs, type);
+    return this->emit(op, type, lhs, rhs);
+}
+
+IROperand IRLowering::lower_call(const CallExpr *call, std::span<const IROperand> args)
+{
+    if (call->name == "println")
+    {
+        // printf is variadic, so the arguments go after the format
+        std::string format;
+        for (std::size_t i = 0; i < args.size(); i++)
+        {
+            switch (this->fn->type_of(args[i]))
+            {
+            case Type::Float:
+                format += "%f";
+                break;
+            case Type::String:
+                format += "%s";
+                break;
+            default:
+                format += "%ld";
+                break;
+            }
+
+            if (i < args.size() - 1)
+                format += " "; // space between arguments
+        }
+        format += "\\n"; // newline at the end
+
+        std::vector<IROperand> printf_args{this->string_constant(format)};
+        printf_args.insert(printf_args.end(), args.begin(), args.end());
+        return this->emit_call({.op = Opcode::Call, .name = "printf", .variadic = 1}, printf_args);
+    }
+
+    // Call the instance for these argument types. Functions that aren't
+    // defined here are external and return a long.
+    this->arg_types.clear();
+    for (IROperand arg : args)
+    {
+        this->arg_types.push_back(this->fn->type_of(arg));
+    }
+    const FunctionInstance *callee = this->types.find(call->symbol, this->arg_types);
+    if (!callee)
+        return this->emit_call({.op = Opcode::Call, .type = Type::Int, .name = call->name}, args);
+    if (this->inliner.inlines(call->symbol))
+        return this->lower_inline(callee, args);
+
+    IRInstruction inst{.op = Opcode::Call, .type = callee->result, .callee = callee,
+                       .name = this->function_name(callee)};
+    inst.invariant = this->globals.is_pure(call->symbol);
+    inst.clobbers = this->globals.writes_globals(call->symbol);
+    return this->emit_call(inst, args);
+}
+
+// Lower the body of callee in place of a call. Parameters are bound to the
+// argument values in a fresh scope, which also rebinds the globals the body
+// reads so that the caller's locals can't capture them.
+IROperand IRLowering::lower_inline(const FunctionInstance *callee, std::span<const IROperand> args)
+{
+    const FunctionStmt *decl = callee->fn;
+
+    // args lives on the value stack, which the body's expressions grow
+    std::vector<IROperand> params(args.begin(), args.end());
+
+    std::size_t caller_depth = this->function_depth;
+    this->locals.push_scope();
+    this->function_depth = this->locals.depth();
+    std::vector<const Expr *> pending;
+    for (const Stmt *stmt : decl->body->statements)
+    {
+        if (auto let = as<LetStmt>(stmt))
+            pending.push_back(let->value);
+        else if (auto expr_stmt = as<ExprStmt>(stmt))
+            pending.push_back(expr_stmt->expr);
+        else if (auto ret = as<ReturnStmt>(stmt); ret && ret->value)
+            pending.push_back(ret->value);
+    }
+    while (!pending.empty())
+    {
+        const Expr *expr = pending.back();
+        pending.pop_back();
+        if (auto ident = as<IdentifierExpr>(expr); ident && this->types.is_global(ident->symbol))
+            this->locals.bind(ident->symbol, no_variable);
+        else if (auto bin = as<BinaryExpr>(expr))
+            pending.insert(pending.end(), {bin->lhs, bin->rhs});
+        else if (auto call = as<CallExpr>(expr))
+            pending.insert(pending.end(), call->arguments.begin(), call->arguments.end());
+    }
+    for (std::size_t i = 0; i < params.size(); i++)
+    {
+        VariableId variable = this->new_variable(this->fn->type_of(params[i]));
+        this->write_variable(variable, this->block, params[i]);
+        this->locals.bind(decl->param_symbols[i], variable);
+    }
+
+    // Inlined functions are straight-line code, up to their first return
+    IROperand result;
+    for (const Stmt *stmt : decl->body->statements)
+    {
+        if (auto let = as<LetStmt>(stmt))
+            this->lower_let(let);
+        else if (auto expr_stmt = as<ExprStmt>(stmt))
+            this->lower_expr(expr_stmt->expr);
+        else if (auto ret = as<ReturnStmt>(stmt))
+        {
+            if (ret->value)
+                result = this->convert(this->lower_expr(ret->value), callee->result);
+            break;
+        }
+    }
+    this->locals.pop_scope();
+    this->function_depth = caller_depth;
+    return result;
+}
+
+void IRLowering::error(const Expr *expr, const std::string &message) const
+{
+    PresumedLocation loc = this->sources.resolve(expr->loc);
+    std::cerr << "[CODEGEN] " << loc.file_name << ":" << loc.line << ":" << loc.column << ": " << message << "\n";
+    std::exit(69);
+}
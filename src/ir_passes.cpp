@@ -0,0 +1,1163 @@
+#include "ir_passes.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <unordered_map>
+#include "evaluator.hpp"
+
+PassManager::PassManager(int level)
+{
+    auto add = [this](std::string_view name)
+    {
+        this->pipeline.push_back(*std::ranges::find(passes, name, &Pass::name));
+    };
+
+    if (level == 0)
+    {
+        add("peephole");
+    }
+    else if (level == 1)
+    {
+        add("copyprop");
+        add("simplify");
+        add("cse");
+        add("dce");
+    }
+    else if (level >= 2)
+    {
+        add("copyprop");
+        add("simplify");
+        add("gvn");
+        add("licm");
+        add("dce");
+    }
+}
+
+bool PassManager::is_pass(std::string_view name)
+{
+    return name == "lower" || std::ranges::find(passes, name, &Pass::name) != std::end(passes);
+}
+
+// Values replaced by another operand, by value id. Replacements can chain.
+struct Replacements
+{
+    std::vector<IROperand> to;
+
+    explicit Replacements(const IRFunction &fn)
+        : to(fn.value_types.size()) {}
+
+    IROperand resolve(IROperand operand) const
+    {
+        while (operand.kind == IROperand::Value && this->to[operand.id].kind != IROperand::None)
+        {
+            operand = this->to[operand.id];
+        }
+        return operand;
+    }
+
+    bool replaced(const IRInstruction &inst) const
+    {
+        return inst.result != IRInstruction::none && this->to[inst.result].kind != IROperand::None;
+    }
+
+    // Replace phis whose arguments are all one value, or the phi itself, by
+    // that value. Replacing one can make another trivial.
+    void remove_trivial_phis(const IRFunction &fn)
+    {
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (const IRBlock &block : fn.blocks)
+            {
+                for (const IRInstruction &phi : block.phis)
+                {
+                    if (this->replaced(phi))
+                        continue;
+
+                    IROperand self = IROperand::value(phi.result);
+                    IROperand same;
+                    bool trivial = phi.arg_count > 0;
+                    for (std::uint32_t i = 0; i < phi.arg_count && trivial; i++)
+                    {
+                        IROperand arg = this->resolve(fn.arguments[phi.first_arg + i]);
+                        if (arg == self || arg == same)
+                            continue;
+                        trivial = same.kind == IROperand::None;
+                        same = arg;
+                    }
+                    if (trivial && same.kind != IROperand::None)
+                    {
+                        this->to[phi.result] = same;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+
+    // Rewrite every use and drop the instructions whose result was replaced
+    void apply(IRFunction &fn) const
+    {
+        for (IRBlock &block : fn.blocks)
+        {
+            auto replaced = [this](const IRInstruction &inst)
+            {
+                return this->replaced(inst);
+            };
+            std::erase_if(block.phis, replaced);
+            std::erase_if(block.instructions, replaced);
+            for (IRInstruction &inst : block.instructions)
+            {
+                inst.a = this->resolve(inst.a);
+                inst.b = this->resolve(inst.b);
+            }
+            block.value = this->resolve(block.value);
+        }
+        for (IROperand &arg : fn.arguments)
+        {
+            arg = this->resolve(arg);
+        }
+    }
+};
+
+static std::vector<BlockId> successors(const IRBlock &block)
+{
+    switch (block.exit)
+    {
+    case IRBlock::Exit::Jump:
+        return {block.target};
+    case IRBlock::Exit::Branch:
+        return {block.target, block.otherwise};
+    default:
+        return {};
+    }
+}
+
+static char operator_char(Opcode op)
+{
+    switch (op)
+    {
+    case Opcode::Add:
+        return '+';
+    case Opcode::Sub:
+        return '-';
+    case Opcode::Mul:
+        return '*';
+    case Opcode::Div:
+        return '/';
+    default:
+        return 0;
+    }
+}
+
+static ConstValue constant_value(IROperand operand)
+{
+    if (operand.kind == IROperand::Float)
+        return {Type::Float, 0, std::bit_cast<double>(operand.bits), {}};
+    return {Type::Int, static_cast<long>(operand.bits), 0, {}};
+}
+
+// Value of an instruction whose operands are constants, computed the way
+// the evaluator does. Nothing for anything else or what would trap.
+static std::optional<IROperand> fold_constants(const IRInstruction &inst)
+{
+    if (inst.op == Opcode::Ne && inst.a.is_constant() && inst.b.is_constant())
+    {
+        bool differ = inst.a.kind == IROperand::Float
+                          ? std::bit_cast<double>(inst.a.bits) != std::bit_cast<double>(inst.b.bits)
+                          : inst.a.bits != inst.b.bits;
+        return IROperand::constant(differ ? 1L : 0L);
+    }
+    if (inst.op == Opcode::IntToFloat && inst.a.kind == IROperand::Int)
+        return IROperand::constant(static_cast<double>(static_cast<long>(inst.a.bits)));
+
+    if (inst.a.kind == IROperand::Int && inst.b.kind == IROperand::Int)
+    {
+        // Shift amounts are taken modulo the width like QBE does
+        std::uint64_t a = inst.a.bits, b = inst.b.bits;
+        if (inst.op == Opcode::Shl)
+            return IROperand::constant(static_cast<long>(a << (b & 63)));
+        if (inst.op == Opcode::Sar)
+            return IROperand::constant(static_cast<long>(a) >> (b & 63));
+        if (inst.op == Opcode::Shr)
+            return IROperand::constant(static_cast<long>(a >> (b & 63)));
+        if (inst.op == Opcode::And)
+            return IROperand::constant(static_cast<long>(a & b));
+    }
+
+    char op = operator_char(inst.op);
+    if (!op || !inst.a.is_constant() || !inst.b.is_constant())
+        return std::nullopt;
+    std::optional<ConstValue> folded = ConstValue::binary(op, constant_value(inst.a), constant_value(inst.b));
+    if (!folded)
+        return std::nullopt;
+    return folded->type == Type::Float ? IROperand::constant(folded->floating) : IROperand::constant(folded->integer);
+}
+
+void propagate_copies(IRFunction &fn)
+{
+    Replacements replace(fn);
+    for (const IRBlock &block : fn.blocks)
+    {
+        for (const IRInstruction &inst : block.instructions)
+        {
+            // A copy that changes class truncates, e.g. to a w exit status
+            if (inst.op == Opcode::Copy && qbe_class(fn.type_of(inst.a)) == qbe_class(inst.type))
+                replace.to[inst.result] = inst.a;
+        }
+    }
+    replace.remove_trivial_phis(fn);
+    replace.apply(fn);
+}
+
+// Multiplier and shift that divide a signed 64-bit value by d with a
+// multiply-high, after Hacker's Delight, 10-1. d isn't -1, 0 or 1.
+struct MagicNumber
+{
+    long multiplier;
+    int shift;
+};
+
+static MagicNumber magic_number(long d)
+{
+    constexpr std::uint64_t two63 = std::uint64_t{1} << 63;
+    std::uint64_t ad = d < 0 ? -static_cast<std::uint64_t>(d) : static_cast<std::uint64_t>(d);
+    std::uint64_t t = two63 + (static_cast<std::uint64_t>(d) >> 63);
+    std::uint64_t anc = t - 1 - t % ad;
+    int p = 63;
+    std::uint64_t q1 = two63 / anc, r1 = two63 - q1 * anc;
+    std::uint64_t q2 = two63 / ad, r2 = two63 - q2 * ad;
+    std::uint64_t delta;
+    do
+    {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc)
+        {
+            q1++;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad)
+        {
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    auto multiplier = static_cast<long>(q2 + 1);
+    return {d < 0 ? -multiplier : multiplier, p - 64};
+}
+
+// Rewrites each block into a fresh instruction list. Instructions that
+// simplify to an existing value are dropped and replaced by it, longer
+// sequences get new values. Only integers are reassociated and strength
+// reduced, and the float identities kept are the ones that hold for -0, inf
+// and NaN.
+class Simplifier
+{
+    IRFunction &fn;
+    Replacements replace;
+    std::vector<IRInstruction> *code = nullptr;
+
+    // Of every value, for finding chains
+    std::vector<std::uint32_t> uses;
+    std::vector<std::uint32_t> position;
+
+    static bool is_chain(const IRInstruction &inst)
+    {
+        return (inst.op == Opcode::Add || inst.op == Opcode::Mul) && inst.type == Type::Int;
+    }
+
+    static bool is_int(IROperand operand, long value)
+    {
+        return operand.kind == IROperand::Int && static_cast<long>(operand.bits) == value;
+    }
+
+    static bool is_float(IROperand operand, double value)
+    {
+        return operand.kind == IROperand::Float && operand.bits == std::bit_cast<std::uint64_t>(value);
+    }
+
+    IROperand emit(Opcode op, IROperand a, IROperand b)
+    {
+        IRInstruction inst{.op = op, .type = Type::Int, .result = this->fn.new_value(Type::Int), .a = a, .b = b};
+        this->replace.to.resize(this->fn.value_types.size());
+        this->code->push_back(inst);
+        return IROperand::value(inst.result);
+    }
+
+    IROperand emit(Opcode op, IROperand a, long b)
+    {
+        return this->emit(op, a, IROperand::constant(b));
+    }
+
+    // High 64 bits of the 128-bit product, from 32-bit halves since QBE has
+    // no multiply-high. After Hacker's Delight, 8-2.
+    IROperand multiply_high(IROperand x, long m)
+    {
+        constexpr long low = 0xffffffff;
+        IROperand u0 = this->emit(Opcode::And, x, low);
+        IROperand u1 = this->emit(Opcode::Sar, x, 32);
+        IROperand w0 = this->emit(Opcode::Mul, u0, m & low);
+        IROperand t = this->emit(Opcode::Add, this->emit(Opcode::Mul, u1, m & low), this->emit(Opcode::Shr, w0, 32));
+        IROperand w1 = this->emit(Opcode::Add, this->emit(Opcode::Mul, u0, m >> 32), this->emit(Opcode::And, t, low));
+        IROperand high = this->emit(Opcode::Add, this->emit(Opcode::Mul, u1, m >> 32), this->emit(Opcode::Sar, t, 32));
+        return this->emit(Opcode::Add, high, this->emit(Opcode::Sar, w1, 32));
+    }
+
+    // Rounds toward zero like the division instruction
+    IROperand divide(IROperand x, long d)
+    {
+        std::uint64_t magnitude = d < 0 ? -static_cast<std::uint64_t>(d) : static_cast<std::uint64_t>(d);
+        if (std::has_single_bit(magnitude))
+        {
+            // Negative values are biased by 2^k - 1 first
+            int k = std::countr_zero(magnitude);
+            IROperand bias = k == 1 ? this->emit(Opcode::Shr, x, 63)
+                                    : this->emit(Opcode::Shr, this->emit(Opcode::Sar, x, 63), 64 - k);
+            IROperand q = this->emit(Opcode::Sar, this->emit(Opcode::Add, x, bias), k);
+            return d < 0 ? this->emit(Opcode::Sub, IROperand::constant(0L), q) : q;
+        }
+
+        MagicNumber magic = magic_number(d);
+        IROperand q = this->multiply_high(x, magic.multiplier);
+        if (d > 0 && magic.multiplier < 0)
+            q = this->emit(Opcode::Add, q, x);
+        else if (d < 0 && magic.multiplier > 0)
+            q = this->emit(Opcode::Sub, q, x);
+        if (magic.shift > 0)
+            q = this->emit(Opcode::Sar, q, magic.shift);
+        return this->emit(Opcode::Add, q, this->emit(Opcode::Shr, q, 63));
+    }
+
+    // Emits inst or something equal, and returns its value
+    IROperand simplify(IRInstruction inst)
+    {
+        IROperand &a = inst.a, &b = inst.b;
+        bool commutative = inst.op == Opcode::Add || inst.op == Opcode::Mul || inst.op == Opcode::Ne;
+        if (commutative && a.is_constant() && !b.is_constant())
+            std::swap(a, b);
+
+        if (inst.op == Opcode::Ne && a == b && this->fn.type_of(a) == Type::Int)
+            return IROperand::constant(0L);
+        if (inst.type == Type::Int && b.kind == IROperand::Int && !a.is_constant())
+        {
+            auto c = static_cast<long>(b.bits);
+            auto magnitude = c < 0 ? -static_cast<std::uint64_t>(c) : static_cast<std::uint64_t>(c);
+            switch (inst.op)
+            {
+            case Opcode::Add:
+            case Opcode::Sub:
+                if (c == 0)
+                    return a;
+                break;
+            case Opcode::Mul:
+                if (c == 0 || c == 1)
+                    return c == 0 ? b : a;
+                if (c == -1)
+                    return this->emit(Opcode::Sub, IROperand::constant(0L), a);
+                if (c > 0 && std::has_single_bit(magnitude))
+                    return this->emit(Opcode::Shl, a, std::countr_zero(magnitude));
+                break;
+            case Opcode::Div:
+                if (c == 1)
+                    return a;
+                // Division by zero and LONG_MIN / -1 are left to trap, and
+                // LONG_MIN has no positive magnitude
+                if (c != 0 && c != -1 && c != LONG_MIN)
+                    return this->divide(a, c);
+                break;
+            default:
+                break;
+            }
+        }
+        if (inst.type == Type::Int && inst.op == Opcode::Sub && a == b)
+            return IROperand::constant(0L);
+
+        if (inst.type == Type::Float && b.kind == IROperand::Float && !a.is_constant())
+        {
+            // x + -0 and x - 0 keep the sign of a zero x, x + 0 doesn't
+            if ((inst.op == Opcode::Add && is_float(b, -0.0)) || (inst.op == Opcode::Sub && is_float(b, 0.0)))
+                return a;
+            if ((inst.op == Opcode::Mul || inst.op == Opcode::Div) && is_float(b, 1.0))
+                return a;
+
+            // Dividing by a power of two multiplies by its exact reciprocal
+            double c = std::bit_cast<double>(b.bits);
+            int exponent;
+            if (inst.op == Opcode::Div && std::isfinite(c) && std::fabs(std::frexp(c, &exponent)) == 0.5 &&
+                std::isnormal(1 / c))
+            {
+                b = IROperand::constant(1 / c);
+                inst.op = Opcode::Mul;
+            }
+        }
+
+        this->code->push_back(inst);
+        return IROperand::value(inst.result);
+    }
+
+    // The leaves of the chain of root, whose inner operations have no other
+    // use and are earlier in the same block
+    void collect_leaves(const std::vector<IRInstruction> &block, const IRInstruction &root,
+                        std::vector<bool> &absorbed, std::vector<IROperand> &leaves)
+    {
+        std::vector<IROperand> stack{root.b, root.a};
+        while (!stack.empty())
+        {
+            IROperand operand = stack.back();
+            stack.pop_back();
+            if (operand.kind == IROperand::Value && this->uses[operand.id] == 1 &&
+                this->position[operand.id] != IRInstruction::none)
+            {
+                const IRInstruction &inner = block[this->position[operand.id]];
+                if (inner.op == root.op && inner.type == root.type)
+                {
+                    absorbed[operand.id] = true;
+                    stack.push_back(inner.b);
+                    stack.push_back(inner.a);
+                    continue;
+                }
+            }
+            leaves.push_back(this->replace.resolve(operand));
+        }
+    }
+
+    // Combine the leaves of a chain pairwise, level by level, so its depth
+    // is logarithmic. Constants are folded into one, which goes last.
+    IROperand rebalance(const IRInstruction &root, const std::vector<IROperand> &leaves)
+    {
+        bool add = root.op == Opcode::Add;
+        std::uint64_t constant = add ? 0 : 1;
+        std::vector<IROperand> terms;
+        for (IROperand leaf : leaves)
+        {
+            if (leaf.kind != IROperand::Int)
+                terms.push_back(leaf);
+            else
+                constant = add ? constant + leaf.bits : constant * leaf.bits;
+        }
+        if (constant != (add ? 0 : 1) || terms.empty())
+            terms.push_back(IROperand::constant(static_cast<long>(constant)));
+
+        while (terms.size() > 2)
+        {
+            std::vector<IROperand> next;
+            for (std::size_t i = 0; i < terms.size(); i += 2)
+            {
+                next.push_back(i + 1 < terms.size() ? this->emit(root.op, terms[i], terms[i + 1]) : terms[i]);
+            }
+            terms = std::move(next);
+        }
+        if (terms.size() == 1)
+            return terms[0];
+        return this->simplify({.op = root.op, .type = root.type, .result = root.result, .a = terms[0], .b = terms[1]});
+    }
+
+    void simplify_block(IRBlock &block)
+    {
+        std::vector<IRInstruction> old = std::move(block.instructions);
+        block.instructions.clear();
+        this->code = &block.instructions;
+
+        // Chains are found from their last operation, which is the one not
+        // absorbed by a later one
+        for (std::size_t i = 0; i < old.size(); i++)
+        {
+            if (old[i].result != IRInstruction::none)
+                this->position[old[i].result] = static_cast<std::uint32_t>(i);
+        }
+        std::vector<bool> absorbed(this->fn.value_types.size());
+        std::unordered_map<ValueId, std::vector<IROperand>> chains;
+        for (std::size_t i = old.size(); i-- > 0;)
+        {
+            if (!is_chain(old[i]) || absorbed[old[i].result])
+                continue;
+            std::vector<IROperand> leaves;
+            this->collect_leaves(old, old[i], absorbed, leaves);
+            if (leaves.size() > 2)
+                chains.emplace(old[i].result, std::move(leaves));
+        }
+        for (const IRInstruction &inst : old)
+        {
+            if (inst.result != IRInstruction::none)
+                this->position[inst.result] = IRInstruction::none;
+        }
+
+        for (IRInstruction inst : old)
+        {
+            if (inst.result != IRInstruction::none && absorbed[inst.result])
+                continue;
+            inst.a = this->replace.resolve(inst.a);
+            inst.b = this->replace.resolve(inst.b);
+
+            IROperand value;
+            auto chain = chains.find(inst.result);
+            if (chain != chains.end())
+                value = this->rebalance(inst, chain->second);
+            else if (inst.result != IRInstruction::none && inst.op != Opcode::Call && inst.op != Opcode::Load &&
+                     inst.op != Opcode::Get)
+                value = this->simplify(inst);
+            else
+            {
+                this->code->push_back(inst);
+                continue;
+            }
+
+            if (value != IROperand::value(inst.result))
+                this->replace.to[inst.result] = value;
+        }
+    }
+
+public:
+    explicit Simplifier(IRFunction &fn)
+        : fn(fn), replace(fn), uses(fn.value_types.size()), position(fn.value_types.size(), IRInstruction::none)
+    {
+        auto use = [this](IROperand operand)
+        {
+            if (operand.kind == IROperand::Value)
+                this->uses[operand.id]++;
+        };
+        for (const IRBlock &block : fn.blocks)
+        {
+            for (const IRInstruction &inst : block.instructions)
+            {
+                use(inst.a);
+                use(inst.b);
+            }
+            use(block.value);
+        }
+        for (IROperand arg : fn.arguments)
+        {
+            use(arg);
+        }
+    }
+
+    void run()
+    {
+        for (IRBlock &block : this->fn.blocks)
+        {
+            this->simplify_block(block);
+        }
+        this->replace.apply(this->fn);
+    }
+};
+
+void simplify_arithmetic(IRFunction &fn)
+{
+    Simplifier(fn).run();
+}
+
+// The dominator tree, by the iterative algorithm of Cooper, Harvey and
+// Kennedy. Unreachable blocks are nobody's child and dominate nothing.
+struct Dominators
+{
+    static constexpr BlockId undefined = UINT32_MAX;
+
+    std::vector<BlockId> idom;
+    std::vector<std::vector<BlockId>> children;
+    std::vector<BlockId> order; // reachable blocks in reverse postorder
+
+    bool dominates(BlockId a, BlockId b) const
+    {
+        if (this->idom[b] == undefined)
+            return false;
+        while (b != a && b != 0)
+        {
+            b = this->idom[b];
+        }
+        return b == a;
+    }
+};
+
+static Dominators dominators(const IRFunction &fn)
+{
+    constexpr BlockId undefined = Dominators::undefined;
+    std::size_t count = fn.blocks.size();
+
+    // Reverse postorder from an explicit stack
+    std::vector<BlockId> postorder;
+    std::vector<bool> seen(count);
+    std::vector<std::pair<BlockId, std::size_t>> stack{{0, 0}};
+    seen[0] = true;
+    while (!stack.empty())
+    {
+        auto [block, next] = stack.back();
+        std::vector<BlockId> succ = successors(fn.blocks[block]);
+        if (next < succ.size())
+        {
+            stack.back().second++;
+            if (!seen[succ[next]])
+            {
+                seen[succ[next]] = true;
+                stack.push_back({succ[next], 0});
+            }
+            continue;
+        }
+        postorder.push_back(block);
+        stack.pop_back();
+    }
+
+    std::vector<std::size_t> number(count);
+    for (std::size_t i = 0; i < postorder.size(); i++)
+    {
+        number[postorder[i]] = i;
+    }
+    std::vector<std::vector<BlockId>> preds(count);
+    for (BlockId block : postorder)
+    {
+        for (BlockId succ : successors(fn.blocks[block]))
+        {
+            preds[succ].push_back(block);
+        }
+    }
+
+    std::vector<BlockId> idom(count, undefined);
+    idom[0] = 0;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (auto it = postorder.rbegin(); it != postorder.rend(); it++)
+        {
+            BlockId block = *it;
+            if (block == 0)
+                continue;
+
+            BlockId dom = undefined;
+            for (BlockId pred : preds[block])
+            {
+                if (idom[pred] == undefined)
+                    continue;
+                if (dom == undefined)
+                {
+                    dom = pred;
+                    continue;
+                }
+                BlockId a = pred, b = dom;
+                while (a != b)
+                {
+                    while (number[a] < number[b])
+                        a = idom[a];
+                    while (number[b] < number[a])
+                        b = idom[b];
+                }
+                dom = a;
+            }
+            if (idom[block] != dom)
+            {
+                idom[block] = dom;
+                changed = true;
+            }
+        }
+    }
+
+    std::vector<std::vector<BlockId>> children(count);
+    for (auto it = postorder.rbegin(); it != postorder.rend(); it++)
+    {
+        if (*it != 0)
+            children[idom[*it]].push_back(*it);
+    }
+    return {std::move(idom), std::move(children), {postorder.rbegin(), postorder.rend()}};
+}
+
+// Hash-based value numbering over blocks in dominator tree order. Pure
+// instructions are looked up by opcode and operands, which are rewritten to
+// their numbers first. Loads are tracked separately since stores and calls
+// change memory: within a block they see the last load or store of their
+// address, and only loads that nothing in the function can change are
+// reused across blocks.
+class ValueNumbering
+{
+    IRFunction &fn;
+    bool across_blocks;
+    Replacements replace;
+
+    struct Key
+    {
+        Opcode op;
+        Type type;
+        IROperand a, b;
+        const FunctionInstance *callee;
+        std::vector<IROperand> args;
+
+        bool operator==(const Key &) const = default;
+    };
+
+    struct KeyHash
+    {
+        static std::size_t mix(std::size_t seed, IROperand operand)
+        {
+            std::size_t h = operand.kind | (std::size_t{operand.id} << 8);
+            h ^= operand.bits + 0x9e3779b97f4a7c15 + (h << 6);
+            return seed ^ (h + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2));
+        }
+
+        std::size_t operator()(const Key &key) const
+        {
+            std::size_t h = static_cast<std::size_t>(key.op) << 8 | static_cast<std::size_t>(key.type);
+            h = mix(mix(h, key.a), key.b);
+            h ^= std::hash<const void *>{}(key.callee);
+            for (IROperand arg : key.args)
+            {
+                h = mix(h, arg);
+            }
+            return h;
+        }
+    };
+
+    std::unordered_map<Key, IROperand, KeyHash> table;
+    std::vector<const Key *> scope_keys;
+
+    // Address, its value and whether calls can't change it, for the current
+    // block only
+    struct Known
+    {
+        IROperand address;
+        IROperand value;
+        bool invariant;
+    };
+    std::vector<Known> memory;
+
+    // Addresses stored to anywhere in the function
+    std::vector<IROperand> stored;
+
+    bool lookup_or_insert(Key key, ValueId result)
+    {
+        auto [it, inserted] = this->table.try_emplace(std::move(key), IROperand::value(result));
+        if (inserted)
+        {
+            this->scope_keys.push_back(&it->first);
+            return false;
+        }
+        this->replace.to[result] = it->second;
+        return true;
+    }
+
+    void remember(IROperand address, IROperand value, bool invariant)
+    {
+        std::erase_if(this->memory, [&](const Known &known)
+        {
+            return known.address == address;
+        });
+        this->memory.push_back({address, value, invariant});
+    }
+
+    // Fold an instruction whose operands are constants, replacing its result
+    bool fold(const IRInstruction &inst)
+    {
+        std::optional<IROperand> folded = fold_constants(inst);
+        if (!folded)
+            return false;
+        this->replace.to[inst.result] = *folded;
+        return true;
+    }
+
+    void visit(IRInstruction &inst)
+    {
+        inst.a = this->replace.resolve(inst.a);
+        inst.b = this->replace.resolve(inst.b);
+        std::span<IROperand> args(this->fn.arguments.data() + inst.first_arg, inst.arg_count);
+        for (IROperand &arg : args)
+        {
+            arg = this->replace.resolve(arg);
+        }
+
+        switch (inst.op)
+        {
+        case Opcode::Copy:
+            if (qbe_class(this->fn.type_of(inst.a)) == qbe_class(inst.type))
+            {
+                this->replace.to[inst.result] = inst.a;
+                break;
+            }
+            this->lookup_or_insert({inst.op, inst.type, inst.a, {}, nullptr, {}}, inst.result);
+            break;
+        case Opcode::Add:
+        case Opcode::Sub:
+        case Opcode::Mul:
+        case Opcode::Div:
+        case Opcode::Shl:
+        case Opcode::Sar:
+        case Opcode::Shr:
+        case Opcode::And:
+        case Opcode::Ne:
+        case Opcode::IntToFloat:
+        case Opcode::FloatToInt:
+            if (!this->fold(inst))
+                this->lookup_or_insert({inst.op, inst.type, inst.a, inst.b, nullptr, {}}, inst.result);
+            break;
+        case Opcode::Load:
+        {
+            auto known = std::ranges::find(this->memory, inst.a, &Known::address);
+            if (known != this->memory.end())
+            {
+                this->replace.to[inst.result] = known->value;
+                break;
+            }
+            bool stable = inst.invariant && std::ranges::find(this->stored, inst.a) == this->stored.end();
+            if (stable && this->lookup_or_insert({inst.op, inst.type, inst.a, {}, nullptr, {}}, inst.result))
+                break;
+            this->remember(inst.a, IROperand::value(inst.result), inst.invariant);
+            break;
+        }
+        case Opcode::Store:
+            this->remember(inst.b, inst.a, inst.invariant);
+            break;
+        case Opcode::Get:
+            // A lazy global has the same value every time it is read
+            this->lookup_or_insert({inst.op, inst.type, inst.a, {}, nullptr, {}}, inst.result);
+            break;
+        case Opcode::Call:
+            if (inst.invariant && inst.result != IRInstruction::none)
+            {
+                this->lookup_or_insert({inst.op, inst.type, {}, {}, inst.callee, {args.begin(), args.end()}}, inst.result);
+            }
+            if (inst.clobbers)
+            {
+                std::erase_if(this->memory, [](const Known &known)
+                {
+                    return !known.invariant;
+                });
+            }
+            break;
+        case Opcode::Phi:
+            // Handled with the block, its arguments come from elsewhere
+            break;
+        }
+    }
+
+    void visit_block(BlockId block)
+    {
+        // Phis merge values from several paths, so they are never reused
+        this->memory.clear();
+        for (IRInstruction &phi : this->fn.blocks[block].phis)
+        {
+            std::span<IROperand> args(this->fn.arguments.data() + phi.first_arg, phi.arg_count);
+            for (IROperand &arg : args)
+            {
+                arg = this->replace.resolve(arg);
+            }
+        }
+        for (IRInstruction &inst : this->fn.blocks[block].instructions)
+        {
+            this->visit(inst);
+        }
+        IRBlock &code = this->fn.blocks[block];
+        code.value = this->replace.resolve(code.value);
+    }
+
+    void pop_scope(std::size_t base)
+    {
+        while (this->scope_keys.size() > base)
+        {
+            this->table.erase(*this->scope_keys.back());
+            this->scope_keys.pop_back();
+        }
+    }
+
+public:
+    ValueNumbering(IRFunction &fn, bool across_blocks)
+        : fn(fn), across_blocks(across_blocks), replace(fn)
+    {
+        for (const IRBlock &block : fn.blocks)
+        {
+            for (const IRInstruction &inst : block.instructions)
+            {
+                if (inst.op == Opcode::Store)
+                    this->stored.push_back(inst.b);
+            }
+        }
+    }
+
+    void run()
+    {
+        if (!this->across_blocks)
+        {
+            for (BlockId block = 0; block < this->fn.blocks.size(); block++)
+            {
+                this->visit_block(block);
+                this->pop_scope(0);
+            }
+        }
+        else
+        {
+            // Leaving a block's subtree forgets what it numbered
+            std::vector<std::vector<BlockId>> children = dominators(this->fn).children;
+            std::vector<std::pair<BlockId, std::size_t>> stack{{0, 0}};
+            this->visit_block(0);
+            std::vector<std::size_t> bases{0};
+            while (!stack.empty())
+            {
+                auto &[block, next] = stack.back();
+                if (next < children[block].size())
+                {
+                    BlockId child = children[block][next++];
+                    bases.push_back(this->scope_keys.size());
+                    this->visit_block(child);
+                    stack.push_back({child, 0});
+                    continue;
+                }
+                this->pop_scope(bases.back());
+                bases.pop_back();
+                stack.pop_back();
+            }
+        }
+        this->replace.remove_trivial_phis(this->fn);
+        this->replace.apply(this->fn);
+    }
+};
+
+void eliminate_common_subexpressions(IRFunction &fn)
+{
+    ValueNumbering(fn, false).run();
+}
+
+void number_values(IRFunction &fn)
+{
+    ValueNumbering(fn, true).run();
+}
+
+// Whether inst is an integer division whose divisor may be 0 or -1
+static bool may_trap(const IRFunction &fn, const IRInstruction &inst)
+{
+    if (inst.op != Opcode::Div || fn.type_of(inst.a) == Type::Float || fn.type_of(inst.b) == Type::Float)
+        return false;
+    return inst.b.kind != IROperand::Int || inst.b.bits == 0 || static_cast<long>(inst.b.bits) == -1;
+}
+
+// What has to run even if nothing uses its value. A call may trap or never
+// return even if it is pure, calls that surely finish were run by the
+// folder already.
+static bool has_effects(const IRFunction &fn, const IRInstruction &inst)
+{
+    return inst.op == Opcode::Store || inst.op == Opcode::Call || inst.op == Opcode::Get || may_trap(fn, inst);
+}
+
+// Mark the values that effects and block exits use, and what those use in
+// turn, then sweep the rest. Phis that only feed each other around a loop
+// are never marked.
+void eliminate_dead_code(IRFunction &fn)
+{
+    std::vector<const IRInstruction *> definitions(fn.value_types.size());
+    for (const IRBlock &block : fn.blocks)
+    {
+        for (const IRInstruction &phi : block.phis)
+        {
+            definitions[phi.result] = &phi;
+        }
+        for (const IRInstruction &inst : block.instructions)
+        {
+            if (inst.result != IRInstruction::none)
+                definitions[inst.result] = &inst;
+        }
+    }
+
+    std::vector<bool> live(fn.value_types.size());
+    std::vector<ValueId> work;
+    auto use = [&](IROperand operand)
+    {
+        if (operand.kind == IROperand::Value && !live[operand.id])
+        {
+            live[operand.id] = true;
+            work.push_back(operand.id);
+        }
+    };
+    auto use_all = [&](const IRInstruction &inst)
+    {
+        use(inst.a);
+        use(inst.b);
+        for (std::uint32_t i = 0; i < inst.arg_count; i++)
+        {
+            use(fn.arguments[inst.first_arg + i]);
+        }
+    };
+
+    for (const IRBlock &block : fn.blocks)
+    {
+        for (const IRInstruction &inst : block.instructions)
+        {
+            if (has_effects(fn, inst))
+                use_all(inst);
+        }
+        use(block.value);
+    }
+    while (!work.empty())
+    {
+        ValueId value = work.back();
+        work.pop_back();
+        // Parameters have no definition
+        if (definitions[value])
+            use_all(*definitions[value]);
+    }
+
+    auto dead = [&](const IRInstruction &inst)
+    {
+        return inst.result != IRInstruction::none && !live[inst.result] && !has_effects(fn, inst);
+    };
+    for (IRBlock &block : fn.blocks)
+    {
+        std::erase_if(block.phis, dead);
+        std::erase_if(block.instructions, dead);
+    }
+}
+
+// Lowering binds every let to a copy and leaves constant operations to the
+// passes, so even unoptimized output needs this much to be readable. Only the
+// copies and folded operations themselves go: anything else stays, even if
+// unused, since it may trap.
+void clean_up(IRFunction &fn)
+{
+    Replacements replace(fn);
+    for (IRBlock &block : fn.blocks)
+    {
+        for (IRInstruction &inst : block.instructions)
+        {
+            inst.a = replace.resolve(inst.a);
+            inst.b = replace.resolve(inst.b);
+            if (inst.op == Opcode::Copy && qbe_class(fn.type_of(inst.a)) == qbe_class(inst.type))
+                replace.to[inst.result] = inst.a;
+            else if (std::optional<IROperand> folded = fold_constants(inst))
+                replace.to[inst.result] = *folded;
+        }
+    }
+    replace.apply(fn);
+}
+
+// Whether inst computes the same value wherever it runs in a loop that
+// neither stores to its address nor calls a function that writes globals,
+// and can't trap if the loop wouldn't have run it
+static bool hoistable(const IRFunction &fn, const IRInstruction &inst, bool memory_changes)
+{
+    switch (inst.op)
+    {
+    case Opcode::Copy:
+    case Opcode::Add:
+    case Opcode::Sub:
+    case Opcode::Mul:
+    case Opcode::Shl:
+    case Opcode::Sar:
+    case Opcode::Shr:
+    case Opcode::And:
+    case Opcode::Ne:
+    case Opcode::IntToFloat:
+    case Opcode::FloatToInt:
+        return true;
+    case Opcode::Div:
+        return !may_trap(fn, inst);
+    case Opcode::Load:
+        return inst.invariant || !memory_changes;
+    default:
+        return false;
+    }
+}
+
+// A loop is found from each back edge, a jump to a block that dominates the
+// jumping one, and is every block that reaches the jump without passing
+// its header. Loops are done innermost first, so what leaves an inner loop
+// can leave the enclosing one too.
+void hoist_loop_invariants(IRFunction &fn)
+{
+    Dominators dom = dominators(fn);
+
+    struct Loop
+    {
+        BlockId header;
+        std::vector<bool> body;
+        std::size_t size = 0;
+    };
+    std::vector<Loop> loops;
+    for (BlockId latch : dom.order)
+    {
+        for (BlockId header : successors(fn.blocks[latch]))
+        {
+            if (!dom.dominates(header, latch))
+                continue;
+
+            auto loop = std::ranges::find(loops, header, &Loop::header);
+            if (loop == loops.end())
+            {
+                loops.push_back({header, std::vector<bool>(fn.blocks.size()), 1});
+                loop = loops.end() - 1;
+                loop->body[header] = true;
+            }
+            std::vector<BlockId> stack{latch};
+            while (!stack.empty())
+            {
+                BlockId block = stack.back();
+                stack.pop_back();
+                if (loop->body[block] || dom.idom[block] == Dominators::undefined)
+                    continue;
+                loop->body[block] = true;
+                loop->size++;
+                stack.insert(stack.end(), fn.blocks[block].predecessors.begin(), fn.blocks[block].predecessors.end());
+            }
+        }
+    }
+    std::ranges::stable_sort(loops, {}, &Loop::size);
+
+    for (const Loop &loop : loops)
+    {
+        // Code can only go where every entry to the loop passes
+        BlockId preheader = Dominators::undefined;
+        std::size_t outside = 0;
+        for (BlockId pred : fn.blocks[loop.header].predecessors)
+        {
+            if (!loop.body[pred])
+            {
+                preheader = pred;
+                outside++;
+            }
+        }
+        if (outside != 1 || fn.blocks[preheader].exit != IRBlock::Exit::Jump)
+            continue;
+
+        std::vector<bool> inside(fn.value_types.size());
+        std::vector<IROperand> stored;
+        bool clobbered = false;
+        for (BlockId block : dom.order)
+        {
+            if (!loop.body[block])
+                continue;
+            for (const IRInstruction &phi : fn.blocks[block].phis)
+            {
+                inside[phi.result] = true;
+            }
+            for (const IRInstruction &inst : fn.blocks[block].instructions)
+            {
+                if (inst.result != IRInstruction::none)
+                    inside[inst.result] = true;
+                if (inst.op == Opcode::Store)
+                    stored.push_back(inst.b);
+                clobbered |= inst.op == Opcode::Call && inst.clobbers;
+            }
+        }
+        auto invariant = [&](IROperand operand)
+        {
+            return operand.kind != IROperand::Value || !inside[operand.id];
+        };
+
+        // Definitions come before uses in reverse postorder, so a hoisted
+        // value's operands are already in the preheader
+        for (BlockId block : dom.order)
+        {
+            if (!loop.body[block])
+                continue;
+            std::vector<IRInstruction> &code = fn.blocks[block].instructions;
+            std::erase_if(code, [&](const IRInstruction &inst)
+            {
+                bool memory_changes = clobbered || std::ranges::find(stored, inst.a) != stored.end();
+                if (!invariant(inst.a) || !invariant(inst.b) || !hoistable(fn, inst, memory_changes))
+                    return false;
+                fn.blocks[preheader].instructions.push_back(inst);
+                inside[inst.result] = false;
+                return true;
+            });
+        }
+    }
+}
@@ -1,16 +1,36 @@
 #include "lexer.hpp"
+#include <charconv>
 
 std::vector<Token> Lexer::tokenize()
 {
     std::vector<Token> tokens;
 
-    while (!this->eof())
+    // Generated code averages well over four bytes per token, so this usually
+    // avoids regrowing (and copying) the vector on large inputs
+    tokens.reserve(this->src.size() / 4);
+
+    Token token;
+    while (this->next(token))
+    {
+        tokens.push_back(token);
+        if (is_number(token.type))
+        {
+            this->literals.push_back(this->literal);
+        }
+    }
+
+    return tokens;
+}
+
+bool Lexer::next(Token &token)
+{
+    while (this->pos < this->limit)
     {
         char c = this->peek();
 
         if (this->is_whitespace(c))
         {
-            this->advance();
+            this->jump_to(this->scan.skip_whitespace(this->cursor(), this->src_end()));
             continue;
         }
 
@@ -22,58 +42,92 @@ std::vector<Token> Lexer::tokenize()
             this->advance();
 
             // Skip until end of line or eof
-            while (!this->eof() && this->peek() != '\n')
-                this->advance();
+            this->jump_to(find_char(this->cursor(), this->src_end(), '\n'));
 
             continue; // Skip comment and continue tokenizing
         }
 
-        if (std::isdigit(c) || (c == '.' && std::isdigit(this->peek_next())))
+        if (has_char_class(c, CharDigit) || (c == '.' && has_char_class(this->peek_next(), CharDigit)))
         {
-            tokens.push_back(this->make_number());
-            continue;
+            token = this->make_number();
+            this->parse_literal(token);
+            return true;
         }
 
-        if (std::isalpha(c) || c == '_')
+        if (has_char_class(c, CharIdentStart))
         {
-            tokens.push_back(this->make_indentifier_or_keyword());
-            continue;
+            token = this->make_indentifier_or_keyword();
+            return true;
         }
 
         if (c == '"')
         {
-            tokens.push_back(this->make_string());
-            continue;
+            token = this->make_string();
+            return true;
         }
 
         if (this->is_symbol(c))
         {
-            tokens.push_back(this->make_symbol());
-            continue;
+            token = this->make_symbol();
+            return true;
         }
 
         this->error(std::string("Unexpected character"));
     }
 
-    return tokens;
+    return false;
 }
 
 std::string Lexer::token_type_to_string(TokenType type)
 {
     switch (type)
     {
-    case TokenType::Keyword:
-        return "Keyword";
-    case TokenType::Identifier:
-        return "Identifier";
     case TokenType::Integer:
         return "Integer";
     case TokenType::Float:
         return "Float";
+    case TokenType::Identifier:
+        return "Identifier";
     case TokenType::String:
         return "String";
-    case TokenType::Symbol:
-        return "Symbol";
+    case TokenType::Let:
+        return "Let";
+    case TokenType::Print:
+        return "Print";
+    case TokenType::If:
+        return "If";
+    case TokenType::Else:
+        return "Else";
+    case TokenType::While:
+        return "While";
+    case TokenType::Fn:
+        return "Fn";
+    case TokenType::Return:
+        return "Return";
+    case TokenType::Equal:
+        return "Equal";
+    case TokenType::Plus:
+        return "Plus";
+    case TokenType::Minus:
+        return "Minus";
+    case TokenType::Star:
+        return "Star";
+    case TokenType::Slash:
+        return "Slash";
+    case TokenType::LeftParen:
+        return "LeftParen";
+    case TokenType::RightParen:
+        return "RightParen";
+    case TokenType::LeftBrace:
+        return "LeftBrace";
+    case TokenType::RightBrace:
+        return "RightBrace";
+    case TokenType::Semicolon:
+        return "Semicolon";
+    case TokenType::Comma:
+        return "Comma";
+    case TokenType::At:
+        return "At";
     default:
         return "Unknown";
     }
@@ -83,9 +137,10 @@ void Lexer::print_tokens(const std::vector<Token> &tokens)
 {
     for (const auto &token : tokens)
     {
+        PresumedLocation loc = this->sources.resolve(this->sources.get_base(this->file) + token.offset);
         std::cout << "[" << token_type_to_string(token.type) << "]"
-                  << "\t\"" << token.value << "\""
-                  << "\tat line " << token.line << ", column " << token.column
+                  << "\t\"" << this->text(token) << "\""
+                  << "\tat line " << loc.line << ", column " << loc.column
                   << std::endl;
     }
 }
@@ -104,19 +159,12 @@ char Lexer::peek_next() const
     return this->src[this->pos + 1];
 }
 
+// Line and column are resolved lazily by the SourceManager, so there is no
+// bookkeeping here.
 char Lexer::advance()
 {
     char c = this->peek();
     ++this->pos;
-    if (c == '\n')
-    {
-        ++this->line;
-        this->col = 1;
-    }
-    else
-    {
-        ++this->col;
-    }
     return c;
 }
 
@@ -127,75 +175,68 @@ bool Lexer::eof() const
 
 bool Lexer::is_whitespace(char c) const
 {
-    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    return has_char_class(c, CharSpace);
 }
 
 bool Lexer::is_symbol(char c) const
 {
-    return this->symbols.find(c) != this->symbols.end();
+    return has_char_class(c, CharSymbol);
 }
 
 Token Lexer::make_number()
 {
-    int start_col = this->col;
-    std::string value;
+    std::uint32_t start = this->pos;
     bool has_dot = false;
 
     // Optional leading dot e.g. '.5'
     if (this->peek() == '.')
     {
         has_dot = true;
-        value += this->advance();
-        if (!std::isdigit(this->peek()))
+        this->advance();
+        if (!has_char_class(this->peek(), CharDigit))
         {
             this->error("Expected digit after decimal point, but got: ");
         }
     }
 
-    while (std::isdigit(this->peek()) || (!has_dot && this->peek() == '.'))
+    this->jump_to(this->scan.skip_digits(this->cursor(), this->src_end()));
+
+    // At most one dot, which may also be trailing e.g. '5.'
+    if (!has_dot && this->peek() == '.')
     {
-        if (this->peek() == '.')
-        {
-            has_dot = true;
-        }
-        value += this->advance();
+        has_dot = true;
+        this->advance();
+        this->jump_to(this->scan.skip_digits(this->cursor(), this->src_end()));
     }
 
+    std::uint32_t length = this->pos - start;
     if (has_dot)
     {
-        return {TokenType::Float, value, this->line, start_col};
+        return {TokenType::Float, start, length};
     }
     else
     {
-        return {TokenType::Integer, value, this->line, start_col};
+        return {TokenType::Integer, start, length};
     }
 }
 
 Token Lexer::make_indentifier_or_keyword()
 {
-    int start_col = this->col;
-
-    std::string ident;
+    std::uint32_t start = this->pos;
 
-    while (std::isalnum(this->peek()) || this->peek() == '_')
-    {
-        ident += this->advance();
-    }
-
-    TokenType type = this->keywords.contains(ident) ? TokenType::Keyword : TokenType::Identifier;
+    this->jump_to(this->scan.skip_identifier(this->cursor(), this->src_end()));
 
-    return Token{type, ident, this->line, start_col};
+    std::uint32_t length = this->pos - start;
+    std::string_view ident = this->src.substr(start, length);
+    return Token{find_keyword(ident), start, length};
 }
 
 Token Lexer::make_string()
 {
-    int start_col = col;
     this->advance(); // skip opening "
-    std::string value;
-    while (this->peek() != '"' && !this->eof())
-    {
-        value += this->advance();
-    }
+    std::uint32_t start = this->pos;
+    this->jump_to(find_char(this->cursor(), this->src_end(), '"'));
+    std::uint32_t length = this->pos - start;
     if (this->peek() == '"')
     {
         this->advance(); // skip closing "
@@ -205,5 +246,28 @@ Token Lexer::make_string()
         this->error("Unterminated string literal");
     }
 
-    return {TokenType::String, value, this->line, start_col};
+    return {TokenType::String, start, length};
+}
+
+void Lexer::parse_literal(const Token &token)
+{
+    const char *first = this->src.data() + token.offset;
+    const char *last = first + token.length;
+
+    LiteralValue &value = this->literal;
+    std::from_chars_result result;
+    if (token.type == TokenType::Integer)
+    {
+        result = std::from_chars(first, last, value.integer);
+    }
+    else
+    {
+        result = std::from_chars(first, last, value.floating);
+    }
+
+    if (result.ec == std::errc::result_out_of_range)
+    {
+        this->pos = token.offset;
+        this->error("Numeric literal out of range");
+    }
 }
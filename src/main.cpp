@@ -1,10 +1,19 @@
 #include <iostream>
 #include <fstream>
-#include <sstream>
+#include "source_manager.hpp"
 #include "lexer.hpp"
 #include "parser.hpp"
+#include "constant_folder.hpp"
+#include "dead_code.hpp"
+#include "global_analysis.hpp"
+#include "inliner.hpp"
+#include "type_inference.hpp"
+#include "ir_lowering.hpp"
+#include "ir_passes.hpp"
 #include "qbe_codegen.hpp"
 #include "ast_printer.hpp"
+#include "flat_ast.hpp"
+#include "ast_file.hpp"
 
 int main(int argc, const char *argv[])
 {
@@ -13,41 +22,250 @@ int main(int argc, const char *argv[])
     //     std::cout << argv[i] << std::endl;
     // }
 
-    if (argc < 2)
+    const char *input_file_path = nullptr;
+
+    // -jN lexes and parses with N threads, -j0 uses every core. Serial by
+    // default, which keeps only a few tokens alive at a time.
+    unsigned threads = 1;
+
+    // Report how much memory the AST takes in tree and flat form
+    bool ast_stats = false;
+
+    // Print the parsed program to stdout. Off by default, the printout is
+    // indented by depth and grows with its square on deep expressions.
+    bool dump_ast = false;
+
+    // Report how many functions and globals were unreachable
+    bool dce_stats = false;
+
+    // --inline-threshold=N inlines functions up to N AST nodes bigger than
+    // the call they replace
+    int inline_threshold = Inliner::default_threshold;
+
+    // -O0 only translates and tidies the IR, -O1 folds and inlines on the AST and cleans up
+    // each block of the IR, -O2 also optimizes across blocks and loops.
+    // --dump-ir-after=PASS prints the IR to stderr once PASS has run.
+    int opt_level = 1;
+    std::string dump_after;
+
+    // --cache-dir=DIR reuses the AST of unchanged inputs, --prelude=FILE puts
+    // the declarations of a binary AST before the input's and --emit-ast=FILE
+    // only writes the input's AST, e.g. to build such a prelude
+    std::string cache_dir;
+    std::string prelude_path;
+    std::string emit_ast_path;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string_view arg = argv[i];
+        if (arg.starts_with("-j"))
+        {
+            threads = static_cast<unsigned>(std::atoi(argv[i] + 2));
+        }
+        else if (arg == "--ast-stats")
+        {
+            ast_stats = true;
+        }
+        else if (arg == "--dump-ast")
+        {
+            dump_ast = true;
+        }
+        else if (arg == "--dce-stats")
+        {
+            dce_stats = true;
+        }
+        else if (arg.starts_with("--inline-threshold="))
+        {
+            inline_threshold = std::atoi(argv[i] + arg.find('=') + 1);
+        }
+        else if (arg.starts_with("-O"))
+        {
+            opt_level = std::atoi(argv[i] + 2);
+        }
+        else if (arg.starts_with("--dump-ir-after="))
+        {
+            dump_after = arg.substr(arg.find('=') + 1);
+            if (!PassManager::is_pass(dump_after))
+            {
+                std::cerr << "Unknown pass: " << dump_after << std::endl;
+                std::exit(69);
+            }
+        }
+        else if (arg.starts_with("--cache-dir="))
+        {
+            cache_dir = arg.substr(arg.find('=') + 1);
+        }
+        else if (arg.starts_with("--prelude="))
+        {
+            prelude_path = arg.substr(arg.find('=') + 1);
+        }
+        else if (arg.starts_with("--emit-ast="))
+        {
+            emit_ast_path = arg.substr(arg.find('=') + 1);
+        }
+        else
+        {
+            input_file_path = argv[i];
+        }
+    }
+
+    if (!input_file_path)
     {
         std::cerr << "No input file provided" << std::endl;
         std::exit(69);
     }
 
-    auto input_file_path = argv[1];
+    // Tokens point into the mapped file, so the manager has to outlive the
+    // lexer and parser
+    SourceManager sources;
+    FileId file = sources.load_file(input_file_path);
+
+    // The parser pulls tokens from the lexer as it goes
+    Lexer lexer(sources, file);
+    // lexer.print_tokens(lexer.tokenize());
 
-    std::ifstream input(input_file_path);
+    // Owns every AST node, freed in one go when main returns
+    AstArena arena;
 
-    std::stringstream content;
-    if (input.is_open())
+    // Symbol ids for every name in the program
+    StringInterner symbols;
+
+    // Names in ASTs loaded from disk point into these mappings
+    std::optional<AstFile> prelude;
+    std::optional<AstFile> cached;
+
+    std::vector<Stmt *> program;
+    if (!prelude_path.empty())
     {
-        content << input.rdbuf();
+        prelude = AstFile::load(prelude_path);
+        std::optional<std::vector<Stmt *>> expanded;
+        if (prelude)
+        {
+            // Register the prelude's source so diagnostics can point into it
+            FileId prelude_file = sources.add_view(std::string(prelude->get_source_name()), prelude->get_source());
+            expanded = prelude->expand(arena, symbols, sources.get_base(prelude_file));
+        }
+        if (!expanded)
+        {
+            std::cerr << "[CACHE] Could not load prelude: " << prelude_path << std::endl;
+            std::exit(69);
+        }
+        program = std::move(*expanded);
     }
 
-    // std::cout << content.str() << '\n';
+    std::string cache_path;
+    if (!cache_dir.empty())
+    {
+        cache_path = AstFile::cache_path(cache_dir, sources.get_contents(file));
+        cached = AstFile::load(cache_path);
+        if (cached && !cached->matches(sources.get_contents(file)))
+        {
+            cached.reset();
+        }
+    }
 
-    Lexer lexer("main.jank", content.str());
-    auto tokens = lexer.tokenize();
-    // lexer.print_tokens(tokens);
+    // A malformed cache file is a miss, and gets overwritten below
+    std::optional<std::vector<Stmt *>> expanded;
+    if (cached && !(expanded = cached->expand(arena, symbols, sources.get_base(file))))
+    {
+        cached.reset();
+    }
 
-    // Parser parser(tokens);
-    auto program = Parser("main.jank", tokens).parse_program();
+    std::vector<Stmt *> input;
+    if (cached)
+    {
+        input = std::move(*expanded);
+    }
+    else if (threads == 1)
+    {
+        input = Parser(sources, file, lexer, arena, symbols).parse_program();
+    }
+    else
+    {
+        auto tokens = lexer.tokenize_parallel(threads);
+        input = Parser::parse_parallel(sources, file, tokens, lexer.get_literals(), arena, symbols, threads);
+    }
 
-    ASTPrinter printer;
-    for (const auto &stmt : program)
+    if (!emit_ast_path.empty())
     {
-        printer.print(stmt.get());
+        if (!AstFile::write(emit_ast_path, FlatAst::build(input), sources, file))
+        {
+            std::cerr << "[CACHE] Could not write AST file: " << emit_ast_path << std::endl;
+            std::exit(69);
+        }
+        return 0;
     }
 
-    std::ofstream fout("out.qbe");
-    QBECodegen codegen(fout);
+    if (!cached && !cache_path.empty() && !AstFile::write(cache_path, FlatAst::build(input), sources, file))
+    {
+        std::cerr << "[CACHE] Could not write cache file: " << cache_path << std::endl;
+    }
+    program.insert(program.end(), input.begin(), input.end());
+
+    if (ast_stats)
+    {
+        FlatAst flat = FlatAst::build(program);
+        std::cerr << "[STATS] Tree AST: " << arena.get_bytes_used() << " bytes\n"
+                  << "[STATS] Flat AST: " << flat.memory_used() << " bytes, "
+                  << flat.size() << " nodes, " << flat.names.size() << " names\n";
+    }
+
+    if (dump_ast)
+    {
+        ASTPrinter printer;
+        for (const auto &stmt : program)
+        {
+            printer.print(stmt);
+        }
+    }
+
+    // Types of every value, functions get an instance per argument types
+    TypeInference types(sources, symbols);
+    types.infer(program);
 
-    codegen.emit_program(program);
+    // Which globals change and which functions are pure
+    GlobalAnalysis globals(symbols.size());
+    globals.analyze(program);
+
+    // Fold constants, run pure calls and propagate immutable bindings
+    if (opt_level > 0)
+        ConstantFolder(arena, symbols, types, globals).run(program);
+
+    // Decide where each global lives now that initializers are folded
+    globals.classify(program);
+
+    // Pick the functions that are expanded where they are called
+    Inliner inliner(symbols.size(), inline_threshold);
+    if (opt_level > 0)
+        inliner.analyze(program);
+
+    // Drop whatever main can't reach
+    DeadCodeEliminator reachable(types, globals, inliner, symbols.size());
+    DeadCodeEliminator::Stats removed = reachable.run(program);
+    if (dce_stats)
+    {
+        std::cerr << "[STATS] Functions: " << removed.live_functions << " of " << removed.functions << " kept\n"
+                  << "[STATS] Instances: " << removed.live_instances << " of " << removed.instances << " kept\n"
+                  << "[STATS] Globals: " << removed.live_globals << " of " << removed.globals << " kept\n";
+    }
+
+    IRModule module;
+    IRLowering(module, sources, symbols, types, globals, reachable, inliner).lower_program(program);
+
+    PassManager(opt_level).run(module, [&](std::string_view pass)
+    {
+        if (pass != dump_after)
+            return;
+        std::cerr << "# IR after " << pass << "\n";
+        QBECodegen dump(std::cerr, symbols);
+        for (const IRFunction &fn : module.functions)
+        {
+            dump.emit_function(fn);
+        }
+    });
+
+    std::ofstream fout("out.qbe");
+    QBECodegen(fout, symbols).emit_module(module);
 
     // QBECodegen qbe_codegen;
     // std::string qbe = qbe_codegen.generate(program);
@@ -0,0 +1,172 @@
+#include "lexer.hpp"
+#include <algorithm>
+#include <thread>
+
+// Below this many bytes per chunk, thread startup costs more than it saves
+static constexpr std::size_t min_chunk_size = 1 << 20;
+
+struct LexChunk
+{
+    // Byte range the worker may start tokens in
+    std::size_t begin = 0;
+    std::size_t end = 0;
+
+    std::vector<Token> tokens;
+    std::vector<LiteralValue> literals;
+
+    // Position the worker stopped at, past end if the last token crossed it
+    std::size_t stop = 0;
+
+    // The worker ran into something it couldn't lex
+    bool failed = false;
+};
+
+// Chunks start right after a newline, so a worker can only be wrong about its
+// starting state if that newline was inside a string literal (comments never
+// span lines). Stitching walks the chunks in order with the true position the
+// previous chunk ended at. When it doesn't match where a worker started, the
+// chunk is re-lexed serially until it produces a token the worker also
+// produced, with the same type, offset and length. Both then end at the same
+// byte, and lexing is stateless between tokens, so from there on the worker's
+// tokens are correct. An offset alone isn't enough: a worker that took a
+// closing quote for an opening one can start a string right where a real
+// token starts. Tokens only store file offsets, so nothing else needs
+// adjusting.
+std::vector<Token> Lexer::tokenize_parallel(unsigned threads)
+{
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::size_t chunk_count = std::min<std::size_t>(threads, this->src.size() / min_chunk_size);
+    if (chunk_count <= 1)
+    {
+        return this->tokenize();
+    }
+
+    // Split at newline boundaries
+    std::vector<LexChunk> chunks(chunk_count);
+    std::size_t begin = this->pos;
+    for (std::size_t i = 0; i < chunk_count; ++i)
+    {
+        std::size_t end = this->src.size();
+        if (i + 1 < chunk_count)
+        {
+            std::size_t target = std::max(begin, this->src.size() * (i + 1) / chunk_count);
+            end = find_char(this->src.data() + target, this->src_end(), '\n') - this->src.data();
+            end = std::min(end + 1, this->src.size());
+        }
+        chunks[i].begin = begin;
+        chunks[i].end = end;
+        begin = end;
+    }
+
+    auto lex_chunk = [this](LexChunk &chunk)
+    {
+        Lexer lexer(this->sources, this->file);
+        lexer.pos = chunk.begin;
+        lexer.limit = chunk.end;
+        lexer.speculative = true;
+        chunk.tokens.reserve((chunk.end - chunk.begin) / 4);
+
+        try
+        {
+            Token token;
+            while (lexer.next(token))
+            {
+                chunk.tokens.push_back(token);
+                if (is_number(token.type))
+                {
+                    chunk.literals.push_back(lexer.literal);
+                }
+            }
+        }
+        catch (const SpeculationFailed &)
+        {
+            chunk.failed = true;
+        }
+        chunk.stop = lexer.pos;
+    };
+
+    std::vector<std::thread> workers;
+    for (std::size_t i = 1; i < chunk_count; ++i)
+    {
+        workers.emplace_back(lex_chunk, std::ref(chunks[i]));
+    }
+    lex_chunk(chunks[0]);
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    std::size_t total = 0;
+    for (const auto &chunk : chunks)
+    {
+        total += chunk.tokens.size();
+    }
+
+    std::vector<Token> tokens;
+    tokens.reserve(total);
+
+    std::size_t true_pos = chunks[0].begin;
+    for (auto &chunk : chunks)
+    {
+        if (!chunk.failed && true_pos == chunk.begin)
+        {
+            tokens.insert(tokens.end(), chunk.tokens.begin(), chunk.tokens.end());
+            this->literals.insert(this->literals.end(), chunk.literals.begin(), chunk.literals.end());
+            true_pos = chunk.stop;
+            continue;
+        }
+
+        // A token from an earlier chunk swallowed this one whole
+        if (true_pos >= chunk.end)
+        {
+            continue;
+        }
+
+        // Re-lex serially from the true position. Real errors are reported
+        // from here, in source order.
+        this->pos = true_pos;
+        this->limit = chunk.end;
+
+        bool rejoined = false;
+        Token token;
+        while (this->next(token))
+        {
+            if (!chunk.failed)
+            {
+                auto it = std::lower_bound(chunk.tokens.begin(), chunk.tokens.end(), token.offset,
+                                           [](const Token &t, std::uint32_t offset)
+                                           { return t.offset < offset; });
+                if (it != chunk.tokens.end() && it->offset == token.offset && it->type == token.type &&
+                    it->length == token.length)
+                {
+                    auto skipped_literals = std::count_if(chunk.tokens.begin(), it, [](const Token &t)
+                                                         { return is_number(t.type); });
+                    tokens.insert(tokens.end(), it, chunk.tokens.end());
+                    this->literals.insert(this->literals.end(), chunk.literals.begin() + skipped_literals, chunk.literals.end());
+                    true_pos = chunk.stop;
+                    rejoined = true;
+                    break;
+                }
+            }
+
+            tokens.push_back(token);
+            if (is_number(token.type))
+            {
+                this->literals.push_back(this->literal);
+            }
+        }
+
+        if (!rejoined)
+        {
+            true_pos = this->pos;
+        }
+    }
+
+    this->pos = true_pos;
+    this->limit = this->src.size();
+    return tokens;
+}
@@ -0,0 +1,163 @@
+#include "parser.hpp"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+// Below this many tokens per slice, handing it to a thread costs more than it saves
+static constexpr std::size_t min_slice_tokens = 1 << 14;
+
+// Slices per thread, so threads that got cheap declarations can pick up more
+static constexpr std::size_t slices_per_thread = 8;
+
+struct ParseSlice
+{
+    // Token range, always ending on a top-level declaration boundary
+    std::size_t begin = 0;
+    std::size_t end = 0;
+
+    // Index of the first literal in the range
+    std::size_t literal_begin = 0;
+
+    // Each worker allocates into its own arena and symbol table, merged once
+    // everything is done
+    AstArena arena;
+    StringInterner symbols;
+    std::vector<SymbolId *> symbol_refs;
+    std::vector<Stmt *> statements;
+
+    // The worker ran into a syntax error
+    bool failed = false;
+};
+
+// A pre-pass over the tokens finds where top-level declarations end: at a ';'
+// or a '}' that closes the outermost brace, neither of which can appear inside
+// an expression. Consecutive declarations are grouped into slices that worker
+// threads take from a shared counter and parse into their own arenas.
+//
+// A slice that parses cleanly produced exactly what a serial parser would, as
+// the parser never looks past the ';' or '}' that ends a declaration. The first
+// slice that fails is parsed again serially up to the end of the program, so
+// errors are reported from the same place and in the same order as
+// parse_program. That also covers unbalanced braces confusing the pre-pass.
+//
+// Merging interns each slice's names into the shared table in source order, so
+// symbol ids come out the same as with a serial parse.
+std::vector<Stmt *> Parser::parse_parallel(const SourceManager &sources, FileId file, const std::vector<Token> &tokens,
+                                           const std::vector<LiteralValue> &literals, AstArena &arena,
+                                           StringInterner &symbols, unsigned threads)
+{
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::size_t target = std::max(min_slice_tokens, tokens.size() / (threads * slices_per_thread));
+
+    // Split at declaration boundaries
+    std::vector<ParseSlice> slices;
+    std::size_t begin = 0;
+    std::size_t literal_begin = 0;
+    std::size_t literal_count = 0;
+    int depth = 0;
+    for (std::size_t i = 0; i < tokens.size() && depth >= 0; ++i)
+    {
+        TokenType type = tokens[i].type;
+        if (is_number(type))
+        {
+            ++literal_count;
+        }
+        else if (type == TokenType::LeftBrace)
+        {
+            ++depth;
+        }
+
+        // An else continues the statement its block closed
+        bool boundary = (type == TokenType::Semicolon && depth == 0) ||
+                        (type == TokenType::RightBrace && --depth == 0 &&
+                         (i + 1 == tokens.size() || tokens[i + 1].type != TokenType::Else));
+        if (boundary && i + 1 - begin >= target)
+        {
+            auto &slice = slices.emplace_back();
+            slice.begin = begin;
+            slice.end = i + 1;
+            slice.literal_begin = literal_begin;
+            begin = i + 1;
+            literal_begin = literal_count;
+        }
+    }
+    if (begin < tokens.size())
+    {
+        auto &slice = slices.emplace_back();
+        slice.begin = begin;
+        slice.end = tokens.size();
+        slice.literal_begin = literal_begin;
+    }
+
+    if (threads == 1 || slices.size() <= 1)
+    {
+        return Parser(sources, file, tokens, literals, arena, symbols).parse_program();
+    }
+
+    std::atomic<std::size_t> next_slice{0};
+    auto worker = [&]()
+    {
+        for (std::size_t i = next_slice++; i < slices.size(); i = next_slice++)
+        {
+            ParseSlice &slice = slices[i];
+            Parser parser(sources, file, tokens, literals, slice.begin, slice.end, slice.literal_begin,
+                          slice.arena, slice.symbols);
+            parser.speculative = true;
+            parser.symbol_refs = &slice.symbol_refs;
+
+            try
+            {
+                slice.statements = parser.parse_program();
+            }
+            catch (const ParseFailed &)
+            {
+                slice.failed = true;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (std::size_t i = 1; i < std::min<std::size_t>(threads, slices.size()); ++i)
+    {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : workers)
+    {
+        thread.join();
+    }
+
+    // Merge in source order
+    std::vector<Stmt *> program;
+    for (auto &slice : slices)
+    {
+        if (slice.failed)
+        {
+            // Reports the error just like a serial parse would, or parses the
+            // rest correctly if the pre-pass was fooled
+            Parser parser(sources, file, tokens, literals, slice.begin, tokens.size(), slice.literal_begin, arena, symbols);
+            auto rest = parser.parse_program();
+            program.insert(program.end(), rest.begin(), rest.end());
+            break;
+        }
+
+        std::vector<SymbolId> remap(slice.symbols.size());
+        for (SymbolId id = 0; id < remap.size(); ++id)
+        {
+            remap[id] = symbols.intern(slice.symbols.get_name(id));
+        }
+        for (SymbolId *symbol : slice.symbol_refs)
+        {
+            *symbol = remap[*symbol];
+        }
+
+        program.insert(program.end(), slice.statements.begin(), slice.statements.end());
+        arena.adopt(std::move(slice.arena));
+    }
+
+    return program;
+}
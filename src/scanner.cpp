@@ -0,0 +1,182 @@
+#include "scanner.hpp"
+#include "lexer_tables.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define JANK_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+static inline bool is_space(char c)
+{
+    return has_char_class(c, CharSpace);
+}
+
+static inline bool is_ident(char c)
+{
+    return has_char_class(c, CharIdentPart);
+}
+
+static inline bool is_digit(char c)
+{
+    return has_char_class(c, CharDigit);
+}
+
+[[maybe_unused]] static const char *skip_whitespace_scalar(const char *p, const char *end)
+{
+    while (p < end && is_space(*p))
+        ++p;
+    return p;
+}
+
+[[maybe_unused]] static const char *skip_identifier_scalar(const char *p, const char *end)
+{
+    while (p < end && is_ident(*p))
+        ++p;
+    return p;
+}
+
+[[maybe_unused]] static const char *skip_digits_scalar(const char *p, const char *end)
+{
+    while (p < end && is_digit(*p))
+        ++p;
+    return p;
+}
+
+#ifdef JANK_SCAN_X86
+
+// Signed byte compares are all SSE2 offers, so shift [lo, hi] down to start at
+// -128 and compare against the shifted upper bound.
+static inline __m128i in_range_sse2(__m128i v, char lo, char hi)
+{
+    __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(-128 - lo)));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(-128 + (hi - lo + 1))));
+}
+
+static inline __m128i whitespace_mask_sse2(__m128i v)
+{
+    __m128i sp = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    __m128i tab = _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'));
+    __m128i nl = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+    __m128i cr = _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'));
+    return _mm_or_si128(_mm_or_si128(sp, tab), _mm_or_si128(nl, cr));
+}
+
+static inline __m128i identifier_mask_sse2(__m128i v)
+{
+    __m128i alpha = in_range_sse2(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+    __m128i digit = in_range_sse2(v, '0', '9');
+    __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(alpha, digit), under);
+}
+
+// Most runs are short, so only go wide once the first byte has been checked.
+#define JANK_SCAN_SSE2(name, mask_fn, scalar_test)                                   \
+    static const char *name(const char *p, const char *end)                          \
+    {                                                                                \
+        if (p < end && !scalar_test(*p))                                             \
+            return p;                                                                \
+        while (end - p >= 16)                                                        \
+        {                                                                            \
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));       \
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(mask_fn(v)));    \
+            if (mask != 0xFFFF)                                                      \
+                return p + __builtin_ctz(~mask);                                     \
+            p += 16;                                                                 \
+        }                                                                            \
+        while (p < end && scalar_test(*p))                                           \
+            ++p;                                                                     \
+        return p;                                                                    \
+    }
+
+static inline __m128i digit_mask_sse2(__m128i v)
+{
+    return in_range_sse2(v, '0', '9');
+}
+
+JANK_SCAN_SSE2(skip_whitespace_sse2, whitespace_mask_sse2, is_space)
+JANK_SCAN_SSE2(skip_identifier_sse2, identifier_mask_sse2, is_ident)
+JANK_SCAN_SSE2(skip_digits_sse2, digit_mask_sse2, is_digit)
+
+#undef JANK_SCAN_SSE2
+
+__attribute__((target("avx2"))) static inline __m256i in_range_avx2(__m256i v, char lo, char hi)
+{
+    __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8(static_cast<char>(-128 - lo)));
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + (hi - lo + 1))), shifted);
+}
+
+__attribute__((target("avx2"))) static inline __m256i whitespace_mask_avx2(__m256i v)
+{
+    __m256i sp = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    __m256i tab = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'));
+    __m256i nl = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+    __m256i cr = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'));
+    return _mm256_or_si256(_mm256_or_si256(sp, tab), _mm256_or_si256(nl, cr));
+}
+
+__attribute__((target("avx2"))) static inline __m256i identifier_mask_avx2(__m256i v)
+{
+    __m256i alpha = in_range_avx2(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+    __m256i digit = in_range_avx2(v, '0', '9');
+    __m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    return _mm256_or_si256(_mm256_or_si256(alpha, digit), under);
+}
+
+__attribute__((target("avx2"))) static inline __m256i digit_mask_avx2(__m256i v)
+{
+    return in_range_avx2(v, '0', '9');
+}
+
+#define JANK_SCAN_AVX2(name, mask_fn, scalar_test)                                   \
+    __attribute__((target("avx2"))) static const char *name(const char *p, const char *end) \
+    {                                                                                \
+        if (p < end && !scalar_test(*p))                                             \
+            return p;                                                                \
+        while (end - p >= 32)                                                        \
+        {                                                                            \
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));    \
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(mask_fn(v))); \
+            if (mask != 0xFFFFFFFFu)                                                 \
+                return p + __builtin_ctz(~mask);                                     \
+            p += 32;                                                                 \
+        }                                                                            \
+        while (p < end && scalar_test(*p))                                           \
+            ++p;                                                                     \
+        return p;                                                                    \
+    }
+
+JANK_SCAN_AVX2(skip_whitespace_avx2, whitespace_mask_avx2, is_space)
+JANK_SCAN_AVX2(skip_identifier_avx2, identifier_mask_avx2, is_ident)
+JANK_SCAN_AVX2(skip_digits_avx2, digit_mask_avx2, is_digit)
+
+#undef JANK_SCAN_AVX2
+
+#endif // JANK_SCAN_X86
+
+static ScanKernels select_scan_kernels()
+{
+#ifdef JANK_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return {skip_whitespace_avx2, skip_identifier_avx2, skip_digits_avx2, "avx2"};
+    }
+    // SSE2 is part of the x86-64 baseline
+    return {skip_whitespace_sse2, skip_identifier_sse2, skip_digits_sse2, "sse2"};
+#else
+    return {skip_whitespace_scalar, skip_identifier_scalar, skip_digits_scalar, "scalar"};
+#endif
+}
+
+const ScanKernels &get_scan_kernels()
+{
+    static const ScanKernels kernels = select_scan_kernels();
+    return kernels;
+}
+
+const char *find_char(const char *p, const char *end, char c)
+{
+    const void *found = std::memchr(p, c, end - p);
+    return found ? static_cast<const char *>(found) : end;
+}
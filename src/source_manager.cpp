@@ -0,0 +1,159 @@
+#include "source_manager.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SourceManager::~SourceManager()
+{
+#ifndef _WIN32
+    for (const auto &file : this->files)
+    {
+        if (file->mapping)
+        {
+            munmap(file->mapping, file->mapping_size);
+        }
+    }
+#endif
+}
+
+FileId SourceManager::load_file(const std::string &path)
+{
+    auto file = std::make_unique<SourceFile>();
+    file->name = path;
+
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "[SOURCE] Could not open file: " << path << std::endl;
+        std::exit(69);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        std::cerr << "[SOURCE] Could not stat file: " << path << std::endl;
+        std::exit(69);
+    }
+
+    // mmap refuses zero-length mappings, an empty file is just an empty view
+    if (st.st_size > 0)
+    {
+        void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            close(fd);
+            std::cerr << "[SOURCE] Could not map file: " << path << std::endl;
+            std::exit(69);
+        }
+        file->mapping = mapping;
+        file->mapping_size = st.st_size;
+        file->contents = std::string_view(static_cast<const char *>(mapping), st.st_size);
+    }
+    close(fd);
+#else
+    std::ifstream input(path, std::ios::binary);
+    if (!input.is_open())
+    {
+        std::cerr << "[SOURCE] Could not open file: " << path << std::endl;
+        std::exit(69);
+    }
+    std::stringstream content;
+    content << input.rdbuf();
+    file->owned = content.str();
+    file->contents = file->owned;
+#endif
+
+    return this->add_file(std::move(file));
+}
+
+FileId SourceManager::add_buffer(const std::string &name, std::string contents)
+{
+    auto file = std::make_unique<SourceFile>();
+    file->name = name;
+    file->owned = std::move(contents);
+    file->contents = file->owned;
+    return this->add_file(std::move(file));
+}
+
+FileId SourceManager::add_view(const std::string &name, std::string_view contents)
+{
+    auto file = std::make_unique<SourceFile>();
+    file->name = name;
+    file->contents = contents;
+    return this->add_file(std::move(file));
+}
+
+FileId SourceManager::add_file(std::unique_ptr<SourceFile> file)
+{
+    // Leave one extra location past the end so end-of-file positions still
+    // belong to the right file
+    std::uint64_t end = static_cast<std::uint64_t>(this->next_base) + file->contents.size() + 1;
+    if (end > std::numeric_limits<SourceLocation>::max())
+    {
+        std::cerr << "[SOURCE] Total input size exceeds 4 GiB at: " << file->name << std::endl;
+        std::exit(69);
+    }
+
+    file->base = this->next_base;
+    this->next_base = static_cast<SourceLocation>(end);
+
+    this->files.push_back(std::move(file));
+    return static_cast<FileId>(this->files.size() - 1);
+}
+
+FileId SourceManager::get_file(SourceLocation loc) const
+{
+    // Files are laid out in load order, find the last one starting at or before loc
+    auto it = std::upper_bound(this->files.begin(), this->files.end(), loc,
+                               [](SourceLocation l, const std::unique_ptr<SourceFile> &f)
+                               { return l < f->base; });
+    return static_cast<FileId>(it - this->files.begin()) - 1;
+}
+
+const std::vector<std::uint32_t> &SourceManager::get_line_starts(const SourceFile &file) const
+{
+    if (file.line_starts.empty())
+    {
+        file.line_starts.push_back(0);
+
+        const char *begin = file.contents.data();
+        const char *end = begin + file.contents.size();
+        for (const char *p = begin; p < end;)
+        {
+            auto nl = static_cast<const char *>(std::memchr(p, '\n', end - p));
+            if (!nl)
+            {
+                break;
+            }
+            file.line_starts.push_back(static_cast<std::uint32_t>(nl - begin + 1));
+            p = nl + 1;
+        }
+    }
+
+    return file.line_starts;
+}
+
+PresumedLocation SourceManager::resolve(SourceLocation loc) const
+{
+    const SourceFile &file = *this->files[this->get_file(loc)];
+    const auto &line_starts = this->get_line_starts(file);
+
+    std::uint32_t offset = loc - file.base;
+    auto it = std::upper_bound(line_starts.begin(), line_starts.end(), offset);
+    int line = static_cast<int>(it - line_starts.begin());
+    int column = static_cast<int>(offset - line_starts[line - 1]) + 1;
+
+    return {file.name, line, column};
+}
@@ -0,0 +1,538 @@
+#include "type_inference.hpp"
+#include <algorithm>
+#include <iostream>
+
+void TypeInference::infer(const std::vector<Stmt *> &program)
+{
+    for (const Stmt *stmt : program)
+    {
+        switch (stmt->kind)
+        {
+        case StmtKind::Function:
+        {
+            auto fn = static_cast<const FunctionStmt *>(stmt);
+            if (this->functions[fn->symbol])
+            {
+                this->error(nullptr, "Function '" + std::string(fn->name) + "' is defined more than once");
+            }
+            this->functions[fn->symbol] = fn;
+            this->declared.push_back(fn);
+            break;
+        }
+        case StmtKind::Let:
+        {
+            auto let = static_cast<const LetStmt *>(stmt);
+            if (this->is_global(let->symbol))
+            {
+                this->error(let->value, "Global '" + std::string(let->name) + "' is defined more than once");
+            }
+            this->global_ids[let->symbol] = static_cast<std::uint32_t>(this->globals.size());
+            this->globals.push_back({let, Type::Unknown, {}});
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    this->instances.emplace_back(nullptr, std::span<const Type>()).result = Type::Void;
+    this->enqueue(0);
+
+    // Instantiate from main first, so functions are specialized for the
+    // arguments they are actually called with
+    auto default_params = [](const FunctionStmt *fn)
+    {
+        return std::vector<Type>(fn->params.size(), Type::Int);
+    };
+    for (const FunctionStmt *fn : this->declared)
+    {
+        if (fn->name == "main")
+        {
+            this->instantiate(fn, default_params(fn));
+        }
+    }
+
+    while (true)
+    {
+        while (!this->worklist.empty())
+        {
+            std::uint32_t instance = this->worklist.back();
+            this->worklist.pop_back();
+            this->instances[instance].queued = false;
+            this->infer_instance(instance);
+        }
+
+        // Functions nobody calls still get compiled, with int parameters
+        bool changed = false;
+        for (const FunctionStmt *fn : this->declared)
+        {
+            if (this->first_instance[fn->symbol] == FunctionInstance::none)
+            {
+                this->instantiate(fn, default_params(fn));
+                changed = true;
+            }
+        }
+        if (changed)
+            continue;
+
+        // Results that stayed unknown only depend on themselves, e.g. a
+        // function that returns nothing but its own call
+        for (FunctionInstance &instance : this->instances)
+        {
+            if (instance.result == Type::Unknown)
+            {
+                instance.result = Type::Int;
+                for (std::uint32_t caller : instance.callers)
+                {
+                    this->enqueue(caller);
+                }
+                changed = true;
+            }
+        }
+        if (!changed)
+            break;
+    }
+
+    this->check_tail_calls();
+}
+
+// Argument types are only final once every instance is inferred
+void TypeInference::check_tail_calls() const
+{
+    for (std::uint32_t index = 0; index < this->instances.size(); index++)
+    {
+        for (auto [call, callee] : this->instances[index].tail_calls)
+        {
+            if (callee != index)
+            {
+                this->error(call, "@tail call of '" + std::string(call->name) +
+                                      "' has other argument types than its caller, so it can't reuse the frame");
+            }
+        }
+    }
+}
+
+std::uint32_t TypeInference::instantiate(const FunctionStmt *fn, std::span<const Type> params)
+{
+    std::uint32_t last = FunctionInstance::none;
+    for (std::uint32_t i = this->first_instance[fn->symbol]; i != FunctionInstance::none; i = this->instances[i].next)
+    {
+        if (std::ranges::equal(this->instances[i].params, params))
+        {
+            return i;
+        }
+        last = i;
+    }
+
+    auto index = static_cast<std::uint32_t>(this->instances.size());
+    this->instances.emplace_back(fn, params);
+    if (last == FunctionInstance::none)
+        this->first_instance[fn->symbol] = index;
+    else
+        this->instances[last].next = index;
+
+    this->enqueue(index);
+    return index;
+}
+
+void TypeInference::enqueue(std::uint32_t instance)
+{
+    if (!this->instances[instance].queued)
+    {
+        this->instances[instance].queued = true;
+        this->worklist.push_back(instance);
+    }
+}
+
+const FunctionInstance *TypeInference::find(SymbolId fn, std::span<const Type> args) const
+{
+    for (const FunctionInstance *instance = this->first(fn); instance; instance = this->next(instance))
+    {
+        if (std::ranges::equal(instance->params, args))
+        {
+            return instance;
+        }
+    }
+    return nullptr;
+}
+
+// Whether running statements can get past their end, judged by structure
+// alone: a branch or a loop whose condition isn't a literal may go either way
+static bool falls_through(std::span<Stmt *const> statements)
+{
+    auto always = [](const Expr *condition)
+    {
+        auto integer = as<IntExpr>(condition);
+        auto floating = as<FloatExpr>(condition);
+        return (integer && integer->value != 0) || (floating && floating->value != 0);
+    };
+
+    for (const Stmt *stmt : statements)
+    {
+        switch (stmt->kind)
+        {
+        case StmtKind::Return:
+            return false;
+        case StmtKind::Block:
+            if (!falls_through(static_cast<const BlockStmt *>(stmt)->statements))
+                return false;
+            break;
+        case StmtKind::If:
+        {
+            auto ifs = static_cast<const IfStmt *>(stmt);
+            if (ifs->else_branch && !falls_through(ifs->then_branch->statements) &&
+                !falls_through(std::span<Stmt *const>(&ifs->else_branch, 1)))
+                return false;
+            break;
+        }
+        case StmtKind::While:
+            // Nothing leaves a loop but its condition and return
+            if (always(static_cast<const WhileStmt *>(stmt)->condition))
+                return false;
+            break;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+void TypeInference::infer_instance(std::uint32_t index)
+{
+    this->current = index;
+    if (index == 0)
+    {
+        this->infer_globals();
+        return;
+    }
+
+    const FunctionStmt *fn = this->instances[index].fn;
+    this->locals.push_scope();
+    for (std::size_t i = 0; i < fn->params.size(); i++)
+    {
+        this->locals.bind(fn->param_symbols[i], this->instances[index].params[i]);
+    }
+
+    // A function without return statements returns void
+    this->result = Type::Unknown;
+    this->returns = false;
+    this->typed_return = nullptr;
+    this->instances[index].tail_calls.clear();
+    this->infer_block(fn, fn->body->statements);
+    this->locals.pop_scope();
+
+    Type result = this->returns ? this->result : Type::Void;
+    if (result != Type::Void && falls_through(fn->body->statements))
+    {
+        this->error(this->typed_return, "'" + std::string(fn->name) + "' doesn't return a value on every path");
+    }
+
+    FunctionInstance &instance = this->instances[index];
+    std::optional<Type> joined = join(instance.result, result);
+    if (!joined)
+    {
+        this->error(this->typed_return, "'" + std::string(fn->name) + "' returns both " +
+                                            type_name(instance.result) + " and " + type_name(result));
+    }
+    if (*joined != instance.result)
+    {
+        instance.result = *joined;
+        for (std::uint32_t caller : instance.callers)
+        {
+            this->enqueue(caller);
+        }
+    }
+}
+
+// Blocks nest about as deep as the parser recursed to read them, so they are
+// walked by recursion too
+void TypeInference::infer_block(const FunctionStmt *fn, std::span<Stmt *const> statements)
+{
+    for (const Stmt *stmt : statements)
+    {
+        switch (stmt->kind)
+        {
+        case StmtKind::Let:
+            this->infer_let(static_cast<const LetStmt *>(stmt));
+            break;
+        case StmtKind::Expr:
+            this->infer_expr(static_cast<const ExprStmt *>(stmt)->expr);
+            break;
+        case StmtKind::Return:
+        {
+            const Expr *value = static_cast<const ReturnStmt *>(stmt)->value;
+            this->returned = value;
+            Type type = value ? this->infer_expr(value) : Type::Void;
+            this->returned = nullptr;
+            if (value && type == Type::Void)
+                this->error(value, "Returned expression has no value");
+
+            std::optional<Type> joined = this->returns ? join(this->result, type) : type;
+            if (!joined)
+            {
+                this->error(value ? value : this->typed_return, "'" + std::string(fn->name) + "' returns both " +
+                                                                    type_name(this->result) + " and " + type_name(type));
+            }
+            this->result = *joined;
+            this->returns = true;
+            if (value && !this->typed_return)
+                this->typed_return = value;
+            break;
+        }
+        case StmtKind::Block:
+            this->locals.push_scope();
+            this->infer_block(fn, static_cast<const BlockStmt *>(stmt)->statements);
+            this->locals.pop_scope();
+            break;
+        case StmtKind::If:
+        {
+            auto ifs = static_cast<const IfStmt *>(stmt);
+            this->infer_condition(ifs->condition);
+            this->locals.push_scope();
+            this->infer_block(fn, ifs->then_branch->statements);
+            this->locals.pop_scope();
+            if (ifs->else_branch)
+            {
+                this->locals.push_scope();
+                this->infer_block(fn, std::span<Stmt *const>(&ifs->else_branch, 1));
+                this->locals.pop_scope();
+            }
+            break;
+        }
+        case StmtKind::While:
+        {
+            auto loop = static_cast<const WhileStmt *>(stmt);
+            this->infer_condition(loop->condition);
+            this->locals.push_scope();
+            this->infer_block(fn, loop->body->statements);
+            this->locals.pop_scope();
+            break;
+        }
+        case StmtKind::Function:
+            break;
+        }
+    }
+}
+
+void TypeInference::infer_let(const LetStmt *let)
+{
+    Type type = this->infer_expr(let->value);
+    if (type == Type::Void)
+        this->error(let->value, "'" + std::string(let->name) + "' is initialized with an expression that has no value");
+
+    // Assigning a local of an enclosing block
+    if (this->locals.is_outer(let->symbol, 1))
+    {
+        Type local = *this->locals.lookup(let->symbol);
+        std::optional<Type> joined = join(local, type);
+        if (!joined || (local != Type::Unknown && *joined != local))
+        {
+            this->error(let->value, std::string("Cannot assign ") + type_name(type) + " to '" +
+                                        std::string(let->name) + "' of type " + type_name(local));
+        }
+        this->locals.assign(let->symbol, *joined);
+        return;
+    }
+
+    // Like the codegen, a let of a global's name assigns the global
+    if (this->is_global(let->symbol))
+        this->assign_global(let, type);
+    else
+        this->locals.bind(let->symbol, type);
+}
+
+void TypeInference::infer_condition(const Expr *condition)
+{
+    Type type = this->infer_expr(condition);
+    if (type != Type::Int && type != Type::Float && type != Type::Unknown)
+        this->error(condition, std::string("Condition has to be a number, not ") + type_name(type));
+}
+
+void TypeInference::infer_globals()
+{
+    for (const Global &global : this->globals)
+    {
+        Type type = this->infer_expr(global.decl->value);
+        if (type == Type::Void)
+            this->error(global.decl->value, "'" + std::string(global.decl->name) + "' is initialized with an expression that has no value");
+        this->assign_global(global.decl, type);
+    }
+}
+
+void TypeInference::assign_global(const LetStmt *let, Type type)
+{
+    Global &global = this->globals[this->global_ids[let->symbol]];
+    std::optional<Type> joined = join(global.type, type);
+    if (!joined)
+    {
+        this->error(let->value, std::string("Cannot assign ") + type_name(type) + " to '" + std::string(let->name) +
+                                    "' of type " + type_name(global.type));
+    }
+
+    if (*joined != global.type)
+    {
+        global.type = *joined;
+        for (std::uint32_t reader : global.readers)
+        {
+            this->enqueue(reader);
+        }
+    }
+}
+
+Type TypeInference::infer_expr(const Expr *root)
+{
+    std::size_t work_base = this->work.size();
+    std::size_t type_base = this->types.size();
+
+    this->work.push_back({root, false});
+    while (this->work.size() > work_base)
+    {
+        auto [expr, children_done] = this->work.back();
+        this->work.pop_back();
+
+        switch (expr->kind)
+        {
+        case ExprKind::Int:
+            this->types.push_back(Type::Int);
+            break;
+        case ExprKind::Float:
+            this->types.push_back(Type::Float);
+            break;
+        case ExprKind::String:
+            this->types.push_back(Type::String);
+            break;
+        case ExprKind::Identifier:
+        {
+            auto ident = static_cast<const IdentifierExpr *>(expr);
+            if (const std::optional<Type> &local = this->locals.lookup(ident->symbol))
+            {
+                this->types.push_back(*local);
+                break;
+            }
+            if (!this->is_global(ident->symbol))
+            {
+                this->error(expr, "Undefined variable: " + std::string(ident->name));
+            }
+
+            Global &global = this->globals[this->global_ids[ident->symbol]];
+            if (global.readers.empty() || global.readers.back() != this->current)
+            {
+                global.readers.push_back(this->current);
+            }
+            this->types.push_back(global.type);
+            break;
+        }
+        case ExprKind::Binary:
+        {
+            auto bin = static_cast<const BinaryExpr *>(expr);
+            if (!children_done)
+            {
+                this->work.push_back({expr, true});
+                this->work.push_back({bin->rhs, false});
+                this->work.push_back({bin->lhs, false});
+                break;
+            }
+
+            Type rhs = this->types.back();
+            this->types.pop_back();
+            Type lhs = this->types.back();
+            this->types.pop_back();
+
+            std::optional<Type> type = arithmetic_type(lhs, rhs);
+            if (!type)
+            {
+                this->error(expr, "Cannot apply '" + std::string(bin->op) + "' to " + type_name(lhs) + " and " + type_name(rhs));
+            }
+            this->types.push_back(*type);
+            break;
+        }
+        case ExprKind::Call:
+        {
+            auto call = static_cast<const CallExpr *>(expr);
+            if (!children_done)
+            {
+                this->work.push_back({expr, true});
+                for (std::size_t i = call->arguments.size(); i-- > 0;)
+                {
+                    this->work.push_back({call->arguments[i], false});
+                }
+                break;
+            }
+
+            std::size_t args = this->types.size() - call->arguments.size();
+            Type type = this->infer_call(call, std::span(this->types).subspan(args));
+            this->types.resize(args);
+            this->types.push_back(type);
+            break;
+        }
+        }
+    }
+
+    Type result = this->types.back();
+    this->types.resize(type_base);
+    return result;
+}
+
+Type TypeInference::infer_call(const CallExpr *call, std::span<const Type> args)
+{
+    for (std::size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == Type::Void)
+            this->error(call->arguments[i], "Argument has no value");
+    }
+
+    // Whether the caller's frame can actually be reused is up to the
+    // argument types, checked once inference is done
+    if (call->tail)
+    {
+        if (call != this->returned)
+            this->error(call, "@tail call of '" + std::string(call->name) + "' isn't the value of a return statement");
+        const FunctionStmt *self = this->instances[this->current].fn;
+        if (call->symbol != self->symbol)
+        {
+            this->error(call, "@tail call of '" + std::string(call->name) + "' doesn't call '" + std::string(self->name) +
+                                  "', the function it returns from");
+        }
+    }
+
+    if (call->name == "println")
+        return Type::Void;
+
+    // Calls to names that aren't defined here go to C, assumed to return a long
+    const FunctionStmt *fn = this->functions[call->symbol];
+    if (!fn)
+        return Type::Int;
+
+    if (args.size() != fn->params.size())
+    {
+        this->error(call, "'" + std::string(call->name) + "' takes " + std::to_string(fn->params.size()) +
+                              " arguments but is called with " + std::to_string(args.size()));
+    }
+
+    // Instantiated once the arguments are known, this caller is inferred
+    // again by then
+    if (std::ranges::find(args, Type::Unknown) != args.end())
+        return Type::Unknown;
+
+    std::uint32_t callee = this->instantiate(fn, args);
+    if (call->tail)
+        this->instances[this->current].tail_calls.emplace_back(call, callee);
+    std::vector<std::uint32_t> &callers = this->instances[callee].callers;
+    if (callers.empty() || callers.back() != this->current)
+    {
+        callers.push_back(this->current);
+    }
+    return this->instances[callee].result;
+}
+
+void TypeInference::error(const Expr *expr, const std::string &message) const
+{
+    std::cerr << "[TYPES] ";
+    if (expr)
+    {
+        PresumedLocation loc = this->sources.resolve(expr->loc);
+        std::cerr << loc.file_name << ":" << loc.line << ":" << loc.column << ": ";
+    }
+    std::cerr << message << "\n";
+    std::exit(69);
+}
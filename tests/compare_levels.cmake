@@ -0,0 +1,46 @@
+# Compiles SOURCE at -O0, -O1 and -O2 and checks that every program prints and
+# exits as EXPECTED says. The first line of EXPECTED is "exit <status>" or
+# "trap", the rest is the output. Run with cmake -P, given JANK, QBE, CXX (to
+# assemble and link), SOURCE, EXPECTED and WORK_DIR.
+
+file(READ ${EXPECTED} expected)
+string(FIND "${expected}" "\n" end)
+string(SUBSTRING "${expected}" 0 ${end} expected_result)
+math(EXPR end "${end} + 1")
+string(SUBSTRING "${expected}" ${end} -1 expected_output)
+
+foreach(level 0 1 2)
+    set(dir ${WORK_DIR}/O${level})
+    file(MAKE_DIRECTORY ${dir})
+
+    # jank writes out.qbe to the directory it runs in
+    execute_process(COMMAND ${JANK} ${SOURCE} -O${level}
+        WORKING_DIRECTORY ${dir} OUTPUT_QUIET RESULT_VARIABLE result)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "jank -O${level} failed: ${result}")
+    endif()
+    execute_process(COMMAND ${QBE} -o out.s out.qbe
+        WORKING_DIRECTORY ${dir} RESULT_VARIABLE result)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "qbe failed on the -O${level} output: ${result}")
+    endif()
+    execute_process(COMMAND ${CXX} out.s -o program
+        WORKING_DIRECTORY ${dir} RESULT_VARIABLE result)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "Linking the -O${level} output failed: ${result}")
+    endif()
+
+    execute_process(COMMAND ${dir}/program
+        WORKING_DIRECTORY ${dir} OUTPUT_VARIABLE output RESULT_VARIABLE result)
+    # A signal comes back as its description instead of an exit status
+    if (result MATCHES "^[0-9]+$")
+        set(result "exit ${result}")
+    else()
+        set(result "trap")
+    endif()
+    if (NOT output STREQUAL expected_output OR NOT result STREQUAL expected_result)
+        message(FATAL_ERROR "-O${level} doesn't behave as ${EXPECTED} says\n"
+            "expected ${expected_result} after printing:\n${expected_output}\n"
+            "got ${result} after printing:\n${output}")
+    endif()
+endforeach()
@@ -0,0 +1,27 @@
+# Lexes a program with a string literal that crosses the boundary between
+# the two chunks of -j2 and checks that it compiles the same as with -j1.
+# The worker for the second chunk starts inside the string, takes its
+# closing quote for an opening one and stays wrong over the quotes that
+# follow. Run with cmake -P, given JANK and WORK_DIR.
+
+# Chunks are at least 1 MB, so the string spans most of a 3.6 MB file
+string(REPEAT "abc def ghi\n" 300000 text)
+file(MAKE_DIRECTORY ${WORK_DIR})
+file(WRITE ${WORK_DIR}/string.jank
+    "fn main() {\n    println(\"${text}\", \"\", \"x\", \"y\"); // \"\n    return 0;\n}\n")
+
+foreach(threads 1 2)
+    set(dir ${WORK_DIR}/j${threads})
+    file(MAKE_DIRECTORY ${dir})
+    execute_process(COMMAND ${JANK} ${WORK_DIR}/string.jank -j${threads}
+        WORKING_DIRECTORY ${dir} OUTPUT_QUIET ERROR_VARIABLE errors RESULT_VARIABLE result)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "jank -j${threads} failed: ${errors}")
+    endif()
+endforeach()
+
+file(READ ${WORK_DIR}/j1/out.qbe serial)
+file(READ ${WORK_DIR}/j2/out.qbe parallel)
+if (NOT serial STREQUAL parallel)
+    message(FATAL_ERROR "-j2 compiled the program differently from -j1")
+endif()